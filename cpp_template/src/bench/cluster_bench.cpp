@@ -0,0 +1,209 @@
+// ReceiveBuffer inlined at -O3 trips -Wstrict-overflow=5 (see delivery_bench.cpp)
+#pragma GCC diagnostic ignored "-Wstrict-overflow"
+
+// C++ standard library headers
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+
+// C system headers
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "types.hpp"
+#include "proposal.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+#include "latency.hpp"
+#include "simulated_network.hpp"
+#include "fifo_uniform_reliable_broadcast.hpp"
+#include "lattice_agreement.hpp"
+
+/**
+ * @brief Whole clusters in one process, over a SimulatedNetwork
+ *
+ * @details Every node runs the full stack down to its FairLossLink, whose
+ * transport is swapped for the simulated network, so any cluster size runs
+ * without root, sockets or `tc`, and the same seed gives the same link
+ * behaviour. Args are (nodes, messages or rounds per node, loss in percent,
+ * one-way delay in microseconds, jitter is a quarter of the delay). Latency is
+ * measured from the call to broadcast()/propose() to each delivery/decision,
+ * on the same clock. Add larger clusters with e.g. ->Args({128, 2, 0, 0}).
+ */
+#define CLUSTER_SEED 42
+#define CLUSTER_TIMEOUT_S 120
+static const size_t PROPOSAL_SIZE = 10;
+static const int DISTINCT_ELEMENTS = 100;
+
+static std::vector<Host> cluster_hosts(size_t nodes) {
+    std::vector<Host> hosts;
+    for (size_t id = 1; id <= nodes; id++) {
+        hosts.emplace_back(id, Address("127.0.0.1", static_cast<uint16_t>(30000 + id))); // Never bound
+    }
+    return hosts;
+}
+
+static LinkConditions cluster_conditions(const benchmark::State &state) {
+    LinkConditions conditions;
+    conditions.loss = static_cast<double>(state.range(2)) / 100;
+    conditions.delay_us = static_cast<uint64_t>(state.range(3));
+    conditions.jitter_us = conditions.delay_us / 4;
+    return conditions;
+}
+
+static void report_latency(benchmark::State &state, const LatencyHistogram &latency) {
+    state.counters["p50_us"] = static_cast<double>(latency.percentile(0.5)) / 1000;
+    state.counters["p99_us"] = static_cast<double>(latency.percentile(0.99)) / 1000;
+    state.counters["p999_us"] = static_cast<double>(latency.percentile(0.999)) / 1000;
+}
+
+// Wait until `done` holds, false on timeout
+template <typename Predicate>
+static bool wait_until(Predicate done) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(CLUSTER_TIMEOUT_S);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) { return false; }
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    return true;
+}
+
+static void BM_ClusterFifo(benchmark::State &state) {
+    auto nodes = static_cast<size_t>(state.range(0));
+    auto messages = static_cast<size_t>(state.range(1));
+    LatencyHistogram latency;
+
+    for (auto _ : state) {
+        Hosts hosts(cluster_hosts(nodes));
+        SimulatedNetwork network(hosts, cluster_conditions(state), CLUSTER_SEED);
+        Transport::set_factory(network.factory());
+
+        // Broadcast time of message i from node s at sent_at[(s - 1) * messages + i - 1]
+        std::unique_ptr<std::atomic<uint64_t>[]> sent_at(new std::atomic<uint64_t>[nodes * messages]);
+        std::atomic<size_t> delivered{0};
+        std::vector<std::unique_ptr<FIFOUniformReliableBroadcast>> frbs;
+        for (const auto &host : hosts) {
+            frbs.emplace_back(new FIFOUniformReliableBroadcast(host, hosts, [&](BroadcastMessage bm) {
+                StringMessage sm(bm.get_payload());
+                size_t i = std::stoull(sm.get_message());
+                latency.record_since(sent_at[(bm.get_source_id() - 1) * messages + i - 1].load(std::memory_order_relaxed));
+                delivered++;
+            }));
+        }
+
+        std::vector<std::thread> broadcasters;
+        for (size_t s = 0; s < nodes; s++) {
+            broadcasters.emplace_back([&, s]() {
+                for (size_t i = 1; i <= messages; i++) {
+                    StringMessage m(std::to_string(i));
+                    sent_at[s * messages + i - 1].store(monotonic_ns(), std::memory_order_relaxed);
+                    frbs[s]->broadcast(m);
+                }
+            });
+        }
+        for (auto &broadcaster : broadcasters) { broadcaster.join(); }
+        bool done = wait_until([&]() { return delivered == nodes * nodes * messages; });
+
+        frbs.clear();
+        Transport::set_factory(nullptr);
+        if (!done) {
+            state.SkipWithError("Timed out waiting for deliveries");
+            break;
+        }
+    }
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * nodes * nodes * messages));
+    report_latency(state, latency);
+}
+
+static void BM_ClusterLattice(benchmark::State &state) {
+    auto nodes = static_cast<size_t>(state.range(0));
+    auto rounds = static_cast<size_t>(state.range(1));
+    LatencyHistogram latency;
+
+    // Silence the protocol's stdout tracing
+    std::cout.setstate(std::ios::failbit);
+    for (auto _ : state) {
+        Hosts hosts(cluster_hosts(nodes));
+        SimulatedNetwork network(hosts, cluster_conditions(state), CLUSTER_SEED);
+        Transport::set_factory(network.factory());
+
+        // Decisions come in round order, so a node's decision count is the round it decides
+        std::unique_ptr<std::atomic<uint64_t>[]> proposed_at(new std::atomic<uint64_t>[nodes * rounds]);
+        std::vector<size_t> decided_rounds(nodes, 0);
+        std::atomic<size_t> decided{0};
+        std::vector<std::unique_ptr<ProposalDomain>> domains;
+        std::vector<std::unique_ptr<LatticeAgreement>> las;
+        for (size_t i = 0; i < nodes; i++) {
+            domains.emplace_back(new ProposalDomain(DISTINCT_ELEMENTS));
+            las.emplace_back(new LatticeAgreement(hosts.get_hosts()[i], hosts, *domains.back(), [&, i](Proposal) noexcept {
+                size_t round = decided_rounds[i]++;
+                latency.record_since(proposed_at[i * rounds + round].load(std::memory_order_relaxed));
+                decided++;
+            }));
+        }
+
+        std::vector<std::thread> proposers;
+        for (size_t i = 0; i < nodes; i++) {
+            proposers.emplace_back([&, i]() {
+                std::mt19937 rng(static_cast<unsigned>(i));
+                std::uniform_int_distribution<int> values(1, DISTINCT_ELEMENTS);
+                for (size_t round = 0; round < rounds; round++) {
+                    Proposal proposal(*domains[i]);
+                    for (size_t j = 0; j < PROPOSAL_SIZE; j++) { proposal.insert(values(rng)); }
+                    proposed_at[i * rounds + round].store(monotonic_ns(), std::memory_order_relaxed);
+                    las[i]->propose(round, proposal);
+                }
+                las[i]->flush();
+            });
+        }
+        for (auto &proposer : proposers) { proposer.join(); }
+        bool done = wait_until([&]() { return decided == nodes * rounds; });
+
+        las.clear();
+        Transport::set_factory(nullptr);
+        if (!done) {
+            state.SkipWithError("Timed out waiting for decisions");
+            break;
+        }
+    }
+    std::cout.clear();
+
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * nodes * rounds));
+    report_latency(state, latency);
+}
+
+BENCHMARK(BM_ClusterFifo)
+    ->ArgNames({"nodes", "messages", "loss", "delay_us"})
+    ->Args({3, 1000, 0, 0})->Args({3, 1000, 10, 0})->Args({3, 1000, 0, 1000})
+    ->Args({8, 200, 0, 0})->Args({32, 10, 0, 0})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK(BM_ClusterLattice)
+    ->ArgNames({"nodes", "rounds", "loss", "delay_us"})
+    ->Args({3, 1000, 0, 0})->Args({3, 1000, 10, 0})->Args({3, 1000, 0, 1000})
+    ->Args({8, 200, 0, 0})->Args({32, 20, 0, 0})
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,119 @@
+// C++ standard library headers
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "proposal.hpp"
+#include "config.hpp"
+
+/**
+ * @brief Parsing a large lattice agreement config
+ *
+ * @details Generates a synthetic config of the given size in MB (64 values per
+ * proposal out of 4096 distinct ones) and reads every proposal from it, either
+ * through LatticeAgreementConfig or with the getline/istringstream loop it used
+ * to run. The file is generated once per size and removed at exit.
+ */
+#define CONFIG_BENCH_PROPOSAL_SIZE 64
+#define CONFIG_BENCH_DISTINCT 4096
+
+struct SyntheticConfig {
+    std::string path;
+    size_t bytes;
+    size_t rounds;
+
+    SyntheticConfig(size_t megabytes) : path("/tmp/da_bench_config_" + std::to_string(getpid()) + "_" + std::to_string(megabytes)) {
+        size_t target = megabytes << 20;
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> values(1, CONFIG_BENCH_DISTINCT);
+
+        // Generate the proposal lines in blocks, then repeat them until the target size
+        std::string block;
+        while (block.size() < (1 << 20)) {
+            for (size_t i = 0; i < CONFIG_BENCH_PROPOSAL_SIZE; i++) {
+                block += std::to_string(values(rng));
+                block += i + 1 < CONFIG_BENCH_PROPOSAL_SIZE ? ' ' : '\n';
+            }
+        }
+        size_t lines_per_block = static_cast<size_t>(std::count(block.begin(), block.end(), '\n'));
+        size_t blocks = std::max<size_t>(target / block.size(), 1);
+        this->rounds = blocks * lines_per_block;
+
+        std::ofstream file(this->path, std::ios::binary);
+        file << this->rounds << " " << CONFIG_BENCH_PROPOSAL_SIZE << " " << CONFIG_BENCH_DISTINCT << "\n";
+        for (size_t i = 0; i < blocks; i++) { file << block; }
+        this->bytes = static_cast<size_t>(file.tellp());
+        if (!file) { throw std::runtime_error("Failed to write " + this->path); }
+    }
+
+    ~SyntheticConfig() {
+        std::remove(this->path.c_str());
+    }
+
+    static const SyntheticConfig &get(size_t megabytes) {
+        static std::map<size_t, std::unique_ptr<SyntheticConfig>> configs;
+        auto &config = configs[megabytes];
+        if (!config) { config = std::make_unique<SyntheticConfig>(megabytes); }
+        return *config;
+    }
+};
+
+static void BM_ConfigMmap(benchmark::State &state) {
+    const auto &synthetic = SyntheticConfig::get(static_cast<size_t>(state.range(0)));
+    size_t total = 0;
+    for (auto _ : state) {
+        LatticeAgreementConfig config(synthetic.path);
+        ProposalDomain domain(config.get_num_distinct_elements());
+        for (size_t i = 0; i < config.get_num_rounds(); i++) {
+            Proposal proposal = config.get_next_proposal(domain);
+            total += proposal.size();
+        }
+    }
+    benchmark::DoNotOptimize(total);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * synthetic.bytes));
+    state.counters["rounds"] = static_cast<double>(synthetic.rounds);
+}
+
+static void BM_ConfigIostream(benchmark::State &state) {
+    const auto &synthetic = SyntheticConfig::get(static_cast<size_t>(state.range(0)));
+    size_t total = 0;
+    for (auto _ : state) {
+        std::ifstream file(synthetic.path);
+        size_t num_rounds, max_proposal_size, num_distinct_elements;
+        file >> num_rounds >> max_proposal_size >> num_distinct_elements;
+        std::string line;
+        std::getline(file, line);
+
+        ProposalDomain domain(num_distinct_elements);
+        for (size_t i = 0; i < num_rounds; i++) {
+            std::getline(file, line);
+            Proposal proposal(domain);
+            std::istringstream iss(line);
+            ProposalValue value;
+            while (iss >> value) {
+                proposal.insert(value);
+            }
+            total += proposal.size();
+        }
+    }
+    benchmark::DoNotOptimize(total);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * synthetic.bytes));
+    state.counters["rounds"] = static_cast<double>(synthetic.rounds);
+}
+
+BENCHMARK(BM_ConfigMmap)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ConfigMmap)->Arg(1024)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ConfigIostream)->Arg(64)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ConfigIostream)->Arg(1024)->Iterations(1)->Unit(benchmark::kMillisecond);
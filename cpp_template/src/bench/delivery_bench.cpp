@@ -0,0 +1,219 @@
+// std::priority_queue inlined at -O3 trips -Wstrict-overflow=5 inside libstdc++'s heap code
+#pragma GCC diagnostic ignored "-Wstrict-overflow"
+
+// C++ standard library headers
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+
+// C system headers
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "types.hpp"
+#include "proposal.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+#include "message_set.hpp"
+#include "ack_table.hpp"
+#include "receive_buffer.hpp"
+#include "concurrent_queue.hpp"
+
+/**
+ * @brief Delivery bookkeeping: message sets, the FIFO receive buffer and the
+ * perfect link send queue
+ *
+ * @details Sets and buffers are sized for NUM_HOSTS hosts, the message ids
+ * cycle so the sets reach a steady size instead of growing without bound.
+ */
+#define NUM_HOSTS 3
+#define SET_IDS (1 << 16)
+
+static const Hosts &bench_hosts() {
+    static std::unique_ptr<Hosts> hosts;
+    if (!hosts) {
+        std::string path = "/tmp/da_bench_delivery_hosts_" + std::to_string(getpid());
+        {
+            std::ofstream file(path);
+            for (size_t id = 1; id <= NUM_HOSTS; id++) { file << id << " 127.0.0.1 " << 12000 + id << "\n"; }
+        }
+        hosts.reset(new Hosts(path));
+        std::remove(path.c_str());
+    }
+    return *hosts;
+}
+
+static void BM_MessageSetInsert(benchmark::State &state) {
+    MessageSet set(bench_hosts());
+    size_t i = 0;
+    for (auto _ : state) {
+        set.insert(i % NUM_HOSTS + 1, i % SET_IDS);
+        i++;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+static void BM_MessageSetContains(benchmark::State &state) {
+    MessageSet set(bench_hosts());
+    for (size_t i = 0; i < SET_IDS; i += 2) { set.insert(i % NUM_HOSTS + 1, i); }
+    size_t i = 0, hits = 0;
+    for (auto _ : state) {
+        hits += set.contains(i % NUM_HOSTS + 1, i % SET_IDS);
+        i++;
+    }
+    benchmark::DoNotOptimize(hits);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+static void BM_MessagePairSetInsertContains(benchmark::State &state) {
+    MessagePairSet set(bench_hosts());
+    size_t i = 0, hits = 0;
+    for (auto _ : state) {
+        size_t source = i % NUM_HOSTS + 1, sender = i / NUM_HOSTS % NUM_HOSTS + 1, id = i % SET_IDS;
+        hits += set.contains(source, sender, id);
+        set.insert(source, sender, id);
+        i++;
+    }
+    benchmark::DoNotOptimize(hits);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+// Arg 0 delivers in sequence order, arg 1 shuffles every block of 64 sequence numbers
+static void BM_ReceiveBufferDeliver(benchmark::State &state) {
+    const size_t block = 64;
+    std::vector<size_t> order(block);
+    std::iota(order.begin(), order.end(), 0);
+    std::mt19937 rng(42);
+    std::vector<std::vector<size_t>> orders;
+    for (size_t i = 0; i < 16; i++) {
+        if (state.range(0) != 0) { std::shuffle(order.begin(), order.end(), rng); }
+        orders.push_back(order);
+    }
+
+    std::shared_ptr<char[]> payload(new char[8]());
+    size_t delivered = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        ReceiveBuffer buffer(bench_hosts());
+        state.ResumeTiming();
+        for (size_t b = 0; b < orders.size(); b++) {
+            for (auto offset : orders[b]) {
+                BroadcastMessage bm(SEQ_NUM_INIT + b * block + offset, 1, 8, payload);
+                delivered += buffer.deliver(std::move(bm)).size();
+            }
+        }
+    }
+    benchmark::DoNotOptimize(delivered);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * orders.size() * block));
+}
+
+// Every thread pushes and drains, the way PerfectLink::send and the sending thread share the queue
+static ConcurrentQueue<TransportMessage> contended_queue;
+
+static void BM_ConcurrentQueueContention(benchmark::State &state) {
+    TransportMessage tm(Host(1, Address("127.0.0.1", 12001)), Host(2, Address("127.0.0.1", 12002)), nullptr, 0);
+    size_t i = 0, popped = 0;
+    for (auto _ : state) {
+        contended_queue.push(tm);
+        if (++i % 64 == 0) { popped += contended_queue.pop_all().size(); }
+    }
+    popped += contended_queue.pop_all().size();
+    benchmark::DoNotOptimize(popped);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+/**
+ * @brief URB ack bookkeeping for one source's messages, relayed by every host
+ *
+ * @details Each iteration takes URB_BATCH new messages from host 1 and, per
+ * sender, hands them over the way one received datagram does. Arg is the
+ * number of hosts. Items are (sender, message) events.
+ */
+#define URB_BATCH 20 // Broadcast messages in a full datagram
+
+static std::vector<Host> urb_hosts(size_t count) {
+    std::vector<Host> hosts;
+    for (size_t id = 1; id <= count; id++) { hosts.emplace_back(id, Address("127.0.0.1", static_cast<uint16_t>(12000 + id))); }
+    return hosts;
+}
+
+// Per event: the message sets and majority scan UniformReliableBroadcast used before AckTable
+static void BM_UrbAcksPerEvent(benchmark::State &state) {
+    Hosts hosts(urb_hosts(static_cast<size_t>(state.range(0))));
+    MessageSet pending(hosts), delivered(hosts);
+    MessagePairSet acked(hosts);
+    size_t majority = hosts.get_host_count() / 2 + 1, seq = SEQ_NUM_INIT, deliveries = 0;
+    for (auto _ : state) {
+        for (const auto &sender : hosts) {
+            for (size_t i = 0; i < URB_BATCH; i++) {
+                acked.insert(1, sender.get_id(), seq + i);
+                if (!pending.contains(1, seq + i)) {
+                    pending.insert(1, seq + i);
+                    continue;
+                }
+                size_t count = 0;
+                for (const auto &host : hosts) { count += acked.contains(1, host.get_id(), seq + i); }
+                if (count >= majority && !delivered.contains(1, seq + i)) {
+                    delivered.insert(1, seq + i);
+                    deliveries++;
+                }
+            }
+        }
+        seq += URB_BATCH;
+    }
+    benchmark::DoNotOptimize(deliveries);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * hosts.get_host_count() * URB_BATCH));
+}
+
+static void BM_UrbAcksBatch(benchmark::State &state) {
+    Hosts hosts(urb_hosts(static_cast<size_t>(state.range(0))));
+    AckTable table(hosts);
+    std::shared_ptr<char[]> payload(new char[8]());
+    std::vector<AckTable::Event> events;
+    std::vector<BroadcastMessage> relays, deliveries;
+    size_t seq = SEQ_NUM_INIT, delivered = 0;
+    for (auto _ : state) {
+        for (const auto &sender : hosts) {
+            events.clear();
+            for (size_t i = 0; i < URB_BATCH; i++) {
+                events.push_back(AckTable::Event{sender.get_id(), BroadcastMessage(seq + i, 1, 8, payload)});
+            }
+            relays.clear();
+            deliveries.clear();
+            table.apply(events, relays, deliveries);
+            delivered += deliveries.size();
+        }
+        seq += URB_BATCH;
+    }
+    benchmark::DoNotOptimize(delivered);
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * hosts.get_host_count() * URB_BATCH));
+}
+
+BENCHMARK(BM_MessageSetInsert);
+BENCHMARK(BM_MessageSetContains);
+BENCHMARK(BM_MessagePairSetInsertContains);
+BENCHMARK(BM_ReceiveBufferDeliver)->Arg(0)->Arg(1);
+BENCHMARK(BM_ConcurrentQueueContention)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_UrbAcksPerEvent)->Arg(3)->Arg(32)->Arg(128);
+BENCHMARK(BM_UrbAcksBatch)->Arg(3)->Arg(32)->Arg(128);
@@ -0,0 +1,373 @@
+// ReceiveBuffer inlined at -O3 trips -Wstrict-overflow=5 (see delivery_bench.cpp)
+#pragma GCC diagnostic ignored "-Wstrict-overflow"
+
+// C++ standard library headers
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+
+// C system headers
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// Project headers
+#include "types.hpp"
+#include "proposal.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+#include "metrics.hpp"
+#include "latency.hpp"
+#include "simulated_network.hpp"
+#include "shm_transport.hpp"
+#include "perfect_link.hpp"
+#include "fifo_uniform_reliable_broadcast.hpp"
+#include "lattice_agreement.hpp"
+
+/**
+ * @brief End-to-end throughput driver (`da_e2e`)
+ *
+ * @details Runs a whole cluster in this process, over loopback UDP, shared
+ * memory (ShmTransport) or a SimulatedNetwork, and counts every node's
+ * deliveries (perfect, fifo) or decisions (agreement) as they happen. The
+ * counts are sampled every window, and the result is written as JSON: per
+ * node the time to first delivery, the completion time and the per-window
+ * series, and for the cluster the steady-state throughput, i.e. deliveries
+ * per second over the full windows between the warm-up and the completion of
+ * the slowest node.
+ *
+ *   da_e2e --mode perfect|fifo|agreement [--nodes 3] [--messages 100000]
+ *          [--network udp|shm|sim] [--loss 0] [--delay-us 0] [--base-port 11001]
+ *          [--window-ms 100] [--warmup-ms 500] [--timeout-s 120] [--output path]
+ *          [--beb direct|tree] [--socket-buffer bytes] [--pacing on|off]
+ *          [--gso on|off]
+ *
+ * In perfect mode every other node sends --messages to the last one, in fifo
+ * mode every node broadcasts --messages (relayed along a tree with --beb
+ * tree), in agreement mode every node proposes --messages rounds.
+ */
+#define E2E_PROPOSAL_SIZE 10
+#define E2E_DISTINCT_ELEMENTS 1000
+
+/**
+ * @brief Deliveries of one node
+ */
+struct NodeProgress {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> first_ns{0};
+    std::atomic<uint64_t> last_ns{0};
+    uint64_t expected{0};
+    std::vector<uint64_t> windows; // Deliveries per window, sampled by the driver
+
+    void delivered() noexcept {
+        uint64_t now = monotonic_ns(), unset = 0;
+        this->first_ns.compare_exchange_strong(unset, now, std::memory_order_relaxed);
+        this->last_ns.store(now, std::memory_order_relaxed);
+        this->count.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool done() const { return this->count.load(std::memory_order_relaxed) >= this->expected; }
+};
+
+/**
+ * @brief `--name value` command line options
+ */
+class Options {
+private:
+    std::map<std::string, std::string> values;
+
+public:
+    Options(int argc, char **argv) {
+        for (int i = 1; i < argc; i++) {
+            std::string name(argv[i]);
+            if (name.rfind("--", 0) != 0 || i + 1 == argc) {
+                throw std::runtime_error("Usage: da_e2e --mode perfect|fifo|agreement [--name value]...");
+            }
+            this->values[name.substr(2)] = argv[++i];
+        }
+    }
+
+    std::string get(const std::string &name, const std::string &default_value) const {
+        auto it = this->values.find(name);
+        return it == this->values.end() ? default_value : it->second;
+    }
+
+    size_t get(const std::string &name, size_t default_value) const {
+        auto it = this->values.find(name);
+        return it == this->values.end() ? default_value : std::stoull(it->second);
+    }
+};
+
+/**
+ * @brief Nodes of one mode, started by start() and torn down by the destructor
+ */
+class Workload {
+public:
+    virtual ~Workload() = default;
+    virtual void start() = 0;
+    virtual void join() = 0; // Wait for the workload threads, only once every node is done
+};
+
+class PerfectWorkload : public Workload {
+private:
+    const Hosts &hosts;
+    size_t messages;
+    std::vector<std::unique_ptr<PerfectLink>> links;
+    std::vector<std::thread> senders;
+
+public:
+    PerfectWorkload(const Hosts &hosts, size_t messages, std::vector<NodeProgress> &progress) : hosts(hosts), messages(messages) {
+        const Host &receiver = hosts.get_hosts().back();
+        for (size_t i = 0; i < hosts.get_host_count(); i++) {
+            NodeProgress &node = progress[i];
+            node.expected = hosts.get_hosts()[i].get_id() == receiver.get_id() ? (hosts.get_host_count() - 1) * messages : 0;
+            this->links.emplace_back(new PerfectLink(hosts.get_hosts()[i], hosts, [&node](TransportMessage) noexcept { node.delivered(); }));
+        }
+    }
+
+    ~PerfectWorkload() override {
+        this->links.clear();
+    }
+
+    void start() override {
+        const Host &receiver = this->hosts.get_hosts().back();
+        for (size_t i = 0; i + 1 < this->links.size(); i++) {
+            this->senders.emplace_back([this, i, &receiver]() {
+                for (size_t m = 1; m <= this->messages; m++) {
+                    StringMessage sm(std::to_string(m));
+                    this->links[i]->send(sm, receiver);
+                }
+            });
+        }
+    }
+
+    void join() override {
+        for (auto &sender : this->senders) { sender.join(); }
+    }
+};
+
+class FifoWorkload : public Workload {
+private:
+    size_t messages;
+    std::vector<std::unique_ptr<FIFOUniformReliableBroadcast>> frbs;
+    std::vector<std::thread> broadcasters;
+
+public:
+    FifoWorkload(const Hosts &hosts, size_t messages, std::vector<NodeProgress> &progress, BebMode beb_mode) : messages(messages) {
+        for (size_t i = 0; i < hosts.get_host_count(); i++) {
+            NodeProgress &node = progress[i];
+            node.expected = hosts.get_host_count() * messages;
+            this->frbs.emplace_back(new FIFOUniformReliableBroadcast(hosts.get_hosts()[i], hosts, [&node](BroadcastMessage) noexcept { node.delivered(); }, beb_mode));
+        }
+    }
+
+    ~FifoWorkload() override {
+        this->frbs.clear();
+    }
+
+    void start() override {
+        for (size_t i = 0; i < this->frbs.size(); i++) {
+            this->broadcasters.emplace_back([this, i]() {
+                for (size_t m = 1; m <= this->messages; m++) {
+                    StringMessage sm(std::to_string(m));
+                    this->frbs[i]->broadcast(sm);
+                }
+            });
+        }
+    }
+
+    void join() override {
+        for (auto &broadcaster : this->broadcasters) { broadcaster.join(); }
+    }
+};
+
+class AgreementWorkload : public Workload {
+private:
+    size_t rounds;
+    std::vector<std::unique_ptr<ProposalDomain>> domains;
+    std::vector<std::unique_ptr<LatticeAgreement>> las;
+    std::vector<std::thread> proposers;
+
+public:
+    AgreementWorkload(const Hosts &hosts, size_t rounds, std::vector<NodeProgress> &progress) : rounds(rounds) {
+        for (size_t i = 0; i < hosts.get_host_count(); i++) {
+            NodeProgress &node = progress[i];
+            node.expected = rounds;
+            this->domains.emplace_back(new ProposalDomain(E2E_DISTINCT_ELEMENTS));
+            this->las.emplace_back(new LatticeAgreement(hosts.get_hosts()[i], hosts, *this->domains.back(), [&node](Proposal) noexcept { node.delivered(); }));
+        }
+    }
+
+    ~AgreementWorkload() override {
+        this->las.clear();
+    }
+
+    void start() override {
+        for (size_t i = 0; i < this->las.size(); i++) {
+            this->proposers.emplace_back([this, i]() {
+                std::mt19937 rng(static_cast<unsigned>(i));
+                std::uniform_int_distribution<int> values(1, E2E_DISTINCT_ELEMENTS);
+                for (size_t round = 0; round < this->rounds; round++) {
+                    Proposal proposal(*this->domains[i]);
+                    for (size_t j = 0; j < E2E_PROPOSAL_SIZE; j++) { proposal.insert(values(rng)); }
+                    this->las[i]->propose(round, proposal);
+                }
+                this->las[i]->flush();
+            });
+        }
+    }
+
+    void join() override {
+        for (auto &proposer : this->proposers) { proposer.join(); }
+    }
+};
+
+static std::string seconds(uint64_t ns) {
+    return std::to_string(static_cast<double>(ns) / 1e9);
+}
+
+// Deliveries per second over the full windows between the warm-up and the last completion
+static double steady_throughput(const std::vector<NodeProgress> &progress, size_t warmup_windows, uint64_t window_ns) {
+    size_t windows = 0;
+    for (const auto &node : progress) { windows = std::max(windows, node.windows.size()); }
+    if (windows <= warmup_windows + 1) { return 0; }
+
+    uint64_t deliveries = 0;
+    for (const auto &node : progress) {
+        for (size_t w = warmup_windows; w + 1 < windows && w < node.windows.size(); w++) { deliveries += node.windows[w]; }
+    }
+    return static_cast<double>(deliveries) / (static_cast<double>((windows - 1 - warmup_windows) * window_ns) / 1e9);
+}
+
+static std::string to_json(const Options &options, const std::vector<NodeProgress> &progress, uint64_t start_ns,
+                           uint64_t elapsed_ns, bool completed, size_t warmup_windows, uint64_t window_ns) {
+    uint64_t total = 0, completion_ns = 0;
+    std::ostringstream nodes;
+    for (size_t i = 0; i < progress.size(); i++) {
+        const NodeProgress &node = progress[i];
+        uint64_t count = node.count.load(), first_ns = node.first_ns.load(), last_ns = node.last_ns.load();
+        total += count;
+        if (node.expected > 0) { completion_ns = std::max(completion_ns, last_ns - start_ns); }
+
+        nodes << (i == 0 ? "" : ",") << "\n    {\"id\":" << i + 1 << ",\"delivered\":" << count << ",\"expected\":" << node.expected;
+        if (count > 0) {
+            nodes << ",\"first_delivery_s\":" << seconds(first_ns - start_ns) << ",\"completion_s\":" << seconds(last_ns - start_ns);
+        }
+        nodes << ",\"windows\":[";
+        for (size_t w = 0; w < node.windows.size(); w++) { nodes << (w == 0 ? "" : ",") << node.windows[w]; }
+        nodes << "]}";
+    }
+
+    std::ostringstream json;
+    json << "{\"mode\":\"" << options.get("mode", std::string()) << "\",\"network\":\"" << options.get("network", std::string("udp"))
+         << "\",\"beb\":\"" << options.get("beb", std::string("direct"))
+         << "\",\"pacing\":\"" << options.get("pacing", std::string("on")) << "\",\"gso\":\"" << options.get("gso", std::string("off")) << "\",\"nodes\":" << progress.size() << ",\"messages\":" << options.get("messages", size_t(0))
+         << ",\"completed\":" << (completed ? "true" : "false") << ",\"elapsed_s\":" << seconds(elapsed_ns)
+         << ",\"completion_s\":" << seconds(completion_ns) << ",\"delivered\":" << total
+         << ",\"throughput\":" << (completion_ns > 0 ? static_cast<double>(total) / (static_cast<double>(completion_ns) / 1e9) : 0)
+         << ",\"steady_throughput\":" << steady_throughput(progress, warmup_windows, window_ns)
+         << ",\"window_s\":" << seconds(window_ns) << ",\"warmup_windows\":" << warmup_windows
+         << ",\n  \"metrics\":" << Metrics::instance().to_json() << ",\n  \"per_node\":[" << nodes.str() << "\n  ]}\n";
+    return json.str();
+}
+
+int main(int argc, char **argv) {
+    Options options(argc, argv);
+    std::string mode = options.get("mode", std::string());
+    size_t node_count = options.get("nodes", size_t(3));
+    size_t messages = options.get("messages", size_t(100000));
+    uint64_t window_ns = options.get("window-ms", size_t(100)) * 1000000;
+    size_t warmup_windows = options.get("warmup-ms", size_t(500)) * 1000000 / window_ns;
+    uint64_t timeout_ns = options.get("timeout-s", size_t(120)) * 1000000000;
+    if (node_count < 2 || window_ns == 0) { throw std::runtime_error("Need at least 2 nodes and a non-zero window"); }
+
+    std::vector<Host> host_list;
+    size_t base_port = options.get("base-port", size_t(11001));
+    for (size_t id = 1; id <= node_count; id++) {
+        host_list.emplace_back(id, Address("127.0.0.1", static_cast<uint16_t>(base_port + id - 1)));
+    }
+    Hosts hosts(host_list);
+
+    std::unique_ptr<SimulatedNetwork> network;
+    if (options.get("network", std::string("udp")) == "sim") {
+        LinkConditions conditions;
+        conditions.loss = static_cast<double>(options.get("loss", size_t(0))) / 100;
+        conditions.delay_us = options.get("delay-us", size_t(0));
+        conditions.jitter_us = conditions.delay_us / 4;
+        network.reset(new SimulatedNetwork(hosts, conditions));
+        Transport::set_factory(network->factory());
+    } else if (options.get("network", std::string("udp")) == "shm") {
+        Transport::set_factory(ShmTransport::create);
+    }
+    UdpTransport::set_socket_buffer(options.get("socket-buffer", static_cast<size_t>(UDP_DEFAULT_SOCKET_BUFFER)));
+    Pacer::set_enabled(options.get("pacing", std::string("on")) != "off");
+    UdpTransport::set_segmentation(options.get("gso", std::string("off")) == "on");
+
+    // Silence the protocol's stdout tracing
+    std::cout.setstate(std::ios::failbit);
+    std::vector<NodeProgress> progress(node_count);
+    std::unique_ptr<Workload> workload;
+    if (mode == "perfect") {
+        workload.reset(new PerfectWorkload(hosts, messages, progress));
+    } else if (mode == "fifo") {
+        BebMode beb_mode = options.get("beb", std::string("direct")) == "tree" ? BebMode::Tree : BebMode::Direct;
+        workload.reset(new FifoWorkload(hosts, messages, progress, beb_mode));
+    } else if (mode == "agreement") {
+        workload.reset(new AgreementWorkload(hosts, messages, progress));
+    } else {
+        throw std::runtime_error("Unknown mode `" + mode + "`, expected perfect, fifo or agreement");
+    }
+
+    // Sample every node's count at the end of each window until all are done
+    uint64_t start_ns = monotonic_ns();
+    workload->start();
+    std::vector<uint64_t> sampled(node_count, 0);
+    bool completed = false;
+    uint64_t now_ns = start_ns;
+    for (size_t w = 1; !completed && now_ns - start_ns < timeout_ns; w++) {
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(start_ns + w * window_ns)));
+        now_ns = monotonic_ns();
+        completed = true;
+        for (size_t i = 0; i < node_count; i++) {
+            uint64_t count = progress[i].count.load(std::memory_order_relaxed);
+            progress[i].windows.push_back(count - sampled[i]);
+            sampled[i] = count;
+            completed = completed && progress[i].done();
+        }
+    }
+    std::cout.clear();
+
+    std::string json = to_json(options, progress, start_ns, now_ns - start_ns, completed, warmup_windows, window_ns);
+    std::string output = options.get("output", std::string());
+    if (output.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(output) << json;
+    }
+    std::cout.flush();
+
+    // Workload threads may be blocked forever after a timeout (e.g. proposers waiting on the window)
+    if (!completed) { _exit(1); }
+    workload->join();
+    workload.reset();
+    Transport::set_factory(nullptr);
+    return 0;
+}
@@ -0,0 +1,154 @@
+// C++ standard library headers
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+
+// C system headers
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "types.hpp"
+#include "proposal.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+#include "round_table.hpp"
+#include "lattice_agreement.hpp"
+
+/**
+ * @brief End-to-end lattice agreement throughput on loopback
+ *
+ * @details Runs `NUM_NODES` LatticeAgreement instances in this process over
+ * real UDP sockets and measures decisions per second until every node has
+ * decided all rounds. Args are (rounds, batch): batch = 1 sends one record per
+ * ProposalBatchMessage (one message per round and peer, as before batching).
+ */
+static const size_t NUM_NODES = 3;
+static const size_t PROPOSAL_SIZE = 10;
+static const int DISTINCT_ELEMENTS = 100;
+static uint16_t next_port = 21000;
+
+static std::string write_hosts_file() {
+    std::string path = "/tmp/da_bench_hosts_" + std::to_string(getpid());
+    std::ofstream file(path);
+    for (size_t id = 1; id <= NUM_NODES; id++) {
+        file << id << " 127.0.0.1 " << next_port++ << "\n";
+    }
+    return path;
+}
+
+static void BM_LatticeDecisions(benchmark::State &state) {
+    auto rounds = static_cast<size_t>(state.range(0));
+    auto batch = static_cast<size_t>(state.range(1));
+
+    // Silence the protocol's stdout tracing
+    std::cout.setstate(std::ios::failbit);
+    for (auto _ : state) {
+        Hosts hosts(write_hosts_file());
+        std::vector<std::unique_ptr<ProposalDomain>> domains;
+        std::vector<std::unique_ptr<LatticeAgreement>> nodes;
+        std::atomic<size_t> decided{0};
+        for (size_t id = 1; id <= NUM_NODES; id++) {
+            domains.emplace_back(new ProposalDomain(DISTINCT_ELEMENTS));
+            nodes.emplace_back(new LatticeAgreement(Host(id, hosts.get_address(id)), hosts, *domains.back(),
+                                                    [&decided](Proposal) noexcept { decided++; }, LA_DEFAULT_WINDOW, batch));
+        }
+
+        std::vector<std::thread> proposers;
+        for (size_t i = 0; i < NUM_NODES; i++) {
+            proposers.emplace_back([&, i]() {
+                std::mt19937 rng(static_cast<unsigned>(i));
+                std::uniform_int_distribution<int> values(1, DISTINCT_ELEMENTS);
+                for (size_t round = 0; round < rounds; round++) {
+                    Proposal proposal(*domains[i]);
+                    for (size_t j = 0; j < PROPOSAL_SIZE; j++) { proposal.insert(values(rng)); }
+                    nodes[i]->propose(round, proposal);
+                }
+                nodes[i]->flush();
+            });
+        }
+        for (auto &proposer : proposers) { proposer.join(); }
+        while (decided < rounds * NUM_NODES) {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+
+        nodes.clear();
+    }
+    std::cout.clear();
+
+    state.counters["decisions_per_second"] = benchmark::Counter(
+        static_cast<double>(rounds * NUM_NODES * state.iterations()), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_LatticeDecisions)->Args({2000, 1})->Args({2000, LA_DEFAULT_BATCH})->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/**
+ * @brief Contention on the lattice round state
+ *
+ * @details Every thread runs the acceptor step (subset check, then replace or
+ * union) on its own rounds of one shared RoundTable, the way concurrent
+ * receive threads would. Arg is the number of stripes: 1 is the former single
+ * global lock.
+ */
+static std::unique_ptr<RoundTable> contended_table;
+
+static void BM_RoundTableContention(benchmark::State &state) {
+    static ProposalDomain domain(DISTINCT_ELEMENTS);
+    static Hosts hosts({Host(1, Address("127.0.0.1", 1)), Host(2, Address("127.0.0.1", 2)), Host(3, Address("127.0.0.1", 3))});
+    if (state.thread_index() == 0) {
+        contended_table.reset(new RoundTable(LA_DEFAULT_WINDOW, hosts, static_cast<size_t>(state.range(0))));
+    }
+
+    std::mt19937 rng(static_cast<unsigned>(state.thread_index()));
+    std::uniform_int_distribution<int> values(1, DISTINCT_ELEMENTS);
+    std::vector<Proposal> proposals;
+    for (size_t i = 0; i < 16; i++) {
+        proposals.emplace_back(domain);
+        for (size_t j = 0; j < PROPOSAL_SIZE; j++) { proposals.back().insert(values(rng)); }
+    }
+
+    auto threads = static_cast<size_t>(state.threads());
+    auto round = static_cast<size_t>(state.thread_index());
+    size_t i = 0;
+    for (auto _ : state) {
+        const Proposal &proposal = proposals[i++ % proposals.size()];
+        contended_table->with_round(round, [&](RoundState &round_state) {
+            if (round_state.accepted_proposal.is_subset(proposal)) {
+                round_state.accepted_proposal = proposal;
+            } else {
+                round_state.accepted_proposal.set_union(proposal);
+            }
+            round_state.ack_count++;
+        });
+        round = (round + threads) % LA_DEFAULT_WINDOW;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+
+    if (state.thread_index() == 0) {
+        contended_table.reset();
+    }
+}
+
+BENCHMARK(BM_RoundTableContention)->Arg(1)->Arg(LA_DEFAULT_STRIPES)->ThreadRange(1, 8)->UseRealTime();
@@ -0,0 +1,184 @@
+// C++ standard library headers
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+// C system headers
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "types.hpp"
+#include "proposal.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+#include "send_buffer.hpp"
+#include "fair_loss_link.hpp"
+
+/**
+ * @brief Message serialization and datagram packing
+ *
+ * @details Round trips serialize a message and parse it back the way the
+ * receiving layer does. Args are the payload size in bytes, or the number of
+ * records for a ProposalBatchMessage. BM_UdpSend sends full datagrams over
+ * loopback, one send each (0) or in segmented sends with GSO and GRO (1).
+ */
+static Host sample_host(size_t id) {
+    return Host(id, Address("127.0.0.1", static_cast<uint16_t>(11000 + id)));
+}
+
+static std::shared_ptr<char[]> sample_payload(size_t length) {
+    std::shared_ptr<char[]> payload(new char[length]);
+    std::memset(payload.get(), 'x', length);
+    return payload;
+}
+
+static void set_bytes(benchmark::State &state, size_t bytes) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+}
+
+static void BM_TransportMessageRoundTrip(benchmark::State &state) {
+    auto payload_length = static_cast<size_t>(state.range(0));
+    TransportMessage tm(sample_host(1), sample_host(2), sample_payload(payload_length), payload_length);
+    size_t length = 0;
+    for (auto _ : state) {
+        auto buffer = tm.serialize(length);
+        TransportMessage received(buffer.get());
+        benchmark::DoNotOptimize(received.get_seq_number());
+    }
+    set_bytes(state, length);
+}
+
+static void BM_BroadcastMessageRoundTrip(benchmark::State &state) {
+    StringMessage m(std::string(static_cast<size_t>(state.range(0)), 'x'));
+    BroadcastMessage bm(m, SEQ_NUM_INIT, 1);
+    size_t length = 0;
+    for (auto _ : state) {
+        auto buffer = bm.serialize(length);
+        BroadcastMessage received(buffer);
+        benchmark::DoNotOptimize(received.get_seq_number());
+    }
+    set_bytes(state, length);
+}
+
+static void BM_ProposalBatchRoundTrip(benchmark::State &state) {
+    auto records = static_cast<size_t>(state.range(0));
+    ProposalDomain domain(1 << 10);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> values(1, 1 << 10);
+    ProposalBatchMessage batch;
+    for (size_t i = 0; i < records; i++) {
+        Proposal proposal(domain);
+        for (size_t j = 0; j < 10; j++) { proposal.insert(values(rng)); }
+        batch.add(ProposalMessage(i, 1, proposal));
+    }
+
+    size_t length = 0;
+    for (auto _ : state) {
+        auto buffer = batch.serialize(length);
+        ProposalBatchMessage received(buffer, domain);
+        benchmark::DoNotOptimize(received.size());
+    }
+    set_bytes(state, length);
+}
+
+// Messages of a given payload size packed into datagrams for 3 hosts
+static void BM_SendBufferPacking(benchmark::State &state) {
+    auto payload_length = static_cast<size_t>(state.range(0));
+    std::string path = "/tmp/da_bench_message_hosts_" + std::to_string(getpid());
+    {
+        std::ofstream file(path);
+        for (size_t id = 1; id <= 3; id++) { file << id << " 127.0.0.1 " << 11000 + id << "\n"; }
+    }
+    Hosts hosts(path);
+    std::remove(path.c_str());
+
+    size_t datagrams = 0, bytes = 0;
+    SendBuffer buffer(hosts, MAX_SEND_BUFFER_SIZE, [&](const Host &, const char *, size_t length, size_t) noexcept {
+        datagrams++;
+        bytes += length;
+    });
+    std::vector<TransportMessage> messages;
+    for (size_t id = 1; id <= 3; id++) {
+        messages.emplace_back(sample_host(1), sample_host(id), sample_payload(payload_length), payload_length);
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        buffer.add_message(messages[i++ % messages.size()]);
+    }
+    buffer.flush();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+    state.counters["messages_per_datagram"] = static_cast<double>(state.iterations()) / static_cast<double>(std::max<size_t>(datagrams, 1));
+    state.counters["datagram_bytes"] = static_cast<double>(bytes) / static_cast<double>(std::max<size_t>(datagrams, 1));
+}
+
+// Full datagrams over loopback UDP, to a receiver thread draining the socket
+static void BM_UdpSend(benchmark::State &state) {
+    bool segmented = state.range(0) != 0;
+    std::string path = "/tmp/da_bench_udp_hosts_" + std::to_string(getpid());
+    {
+        std::ofstream file(path);
+        for (size_t id = 1; id <= 2; id++) { file << id << " 127.0.0.1 " << 11200 + id << "\n"; }
+    }
+    Hosts hosts(path);
+    std::remove(path.c_str());
+
+    UdpTransport::set_segmentation(segmented);
+    UdpTransport sender(hosts.get_host(1), hosts), receiver(hosts.get_host(2), hosts);
+    UdpTransport::set_segmentation(false);
+    if (segmented && sender.max_segments() == 1) {
+        state.SkipWithError("UDP_GRO not supported");
+        return;
+    }
+
+    std::atomic<bool> done{false};
+    std::atomic<size_t> received{0};
+    std::thread drain([&]() noexcept {
+        char buffer[MAX_RECEIVE_BUFFER_SIZE];
+        while (!done) {
+            ssize_t length = receiver.receive(buffer, sizeof(buffer));
+            if (length > 0) { received += static_cast<size_t>(length); }
+        }
+    });
+
+    size_t segments = segmented ? std::min<size_t>(sender.max_segments(), UDP_MAX_PAYLOAD / MAX_SEND_BUFFER_SIZE) : 1;
+    std::vector<char> payload(segments * MAX_SEND_BUFFER_SIZE, 'x');
+    for (auto _ : state) {
+        sender.send_segments(hosts.get_host(2), payload.data(), payload.size(), MAX_SEND_BUFFER_SIZE);
+    }
+    done = true;
+    receiver.shutdown();
+    drain.join();
+
+    auto sent = static_cast<double>(state.iterations()) * static_cast<double>(payload.size());
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * segments));
+    state.SetBytesProcessed(static_cast<int64_t>(sent));
+    state.counters["received_ratio"] = static_cast<double>(received) / sent;
+}
+
+BENCHMARK(BM_TransportMessageRoundTrip)->Arg(16)->Arg(256)->Arg(1024);
+BENCHMARK(BM_BroadcastMessageRoundTrip)->Arg(16)->Arg(256)->Arg(1024);
+BENCHMARK(BM_ProposalBatchRoundTrip)->Arg(1)->Arg(64);
+BENCHMARK(BM_SendBufferPacking)->Arg(16)->Arg(256)->Arg(1024);
+BENCHMARK(BM_UdpSend)->Arg(0)->Arg(1)->UseRealTime();
@@ -0,0 +1,82 @@
+// C++ standard library headers
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "proposal.hpp"
+#include "output.hpp"
+
+/**
+ * @brief Cost of logging an event on the delivery thread
+ *
+ * @details OutputFile pushes the event to its writer thread. The Ofstream
+ * references build the line with std::to_string and write it to a
+ * std::ofstream on the calling thread, as the output used to.
+ */
+static std::string output_path() {
+    return "/tmp/da_bench_output_" + std::to_string(getpid());
+}
+
+static void BM_OutputFileDeliver(benchmark::State &state) {
+    OutputFile output(output_path());
+    uint64_t seq = 0;
+    for (auto _ : state) {
+        output.deliver(3, ++seq);
+    }
+    output.flush();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+static void BM_OfstreamDeliver(benchmark::State &state) {
+    std::ofstream output(output_path());
+    uint64_t seq = 0;
+    for (auto _ : state) {
+        output << "d " + std::to_string(3) + " " + std::to_string(++seq) + "\n";
+    }
+    output.flush();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+static Proposal sample_proposal(ProposalDomain &domain, size_t size) {
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> values(1, 1 << 20);
+    Proposal proposal(domain);
+    while (proposal.size() < size) { proposal.insert(values(rng)); }
+    return proposal;
+}
+
+static void BM_OutputFileDecide(benchmark::State &state) {
+    ProposalDomain domain(1 << 16);
+    Proposal proposal = sample_proposal(domain, static_cast<size_t>(state.range(0)));
+    OutputFile output(output_path());
+    for (auto _ : state) {
+        output.decide(proposal);
+    }
+    output.flush();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+static void BM_OfstreamDecide(benchmark::State &state) {
+    ProposalDomain domain(1 << 16);
+    Proposal proposal = sample_proposal(domain, static_cast<size_t>(state.range(0)));
+    std::ofstream output(output_path());
+    for (auto _ : state) {
+        std::string message;
+        proposal.for_each([&](ProposalValue value) { message += std::to_string(value) + " "; });
+        message += "\n";
+        output << message;
+    }
+    output.flush();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()));
+}
+
+BENCHMARK(BM_OutputFileDeliver);
+BENCHMARK(BM_OfstreamDeliver);
+BENCHMARK(BM_OutputFileDecide)->Arg(10)->Arg(100);
+BENCHMARK(BM_OfstreamDecide)->Arg(10)->Arg(100);
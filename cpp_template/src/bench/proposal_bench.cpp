@@ -0,0 +1,166 @@
+// C++ standard library headers
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// C system headers
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "proposal.hpp"
+#include "message.hpp"
+
+/**
+ * @brief Proposal union/subset throughput
+ *
+ * @details Args are (ds, elements): the domain size and the number of values
+ * in the larger proposal. The smaller proposal holds half of those values, so
+ * is_subset always has to look at the whole set. elements = ds / 2 exercises
+ * the bitset representation, elements = 16 the sorted small-vector.
+ */
+static std::vector<ProposalValue> sample_values(size_t ds, size_t elements) {
+    std::vector<ProposalValue> values(ds);
+    std::iota(values.begin(), values.end(), 1);
+    std::shuffle(values.begin(), values.end(), std::mt19937(42));
+    values.resize(elements);
+    return values;
+}
+
+static void set_items(benchmark::State &state) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(1));
+}
+
+static void BM_ProposalIsSubset(benchmark::State &state) {
+    auto ds = static_cast<size_t>(state.range(0));
+    auto values = sample_values(ds, static_cast<size_t>(state.range(1)));
+    ProposalDomain domain(ds);
+    Proposal subset(domain), superset(domain);
+    for (size_t i = 0; i < values.size(); i++) {
+        superset.insert(values[i]);
+        if (i % 2 == 0) { subset.insert(values[i]); }
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(subset.is_subset(superset));
+    }
+    set_items(state);
+}
+
+static void BM_ProposalUnion(benchmark::State &state) {
+    auto ds = static_cast<size_t>(state.range(0));
+    auto values = sample_values(ds, static_cast<size_t>(state.range(1)));
+    ProposalDomain domain(ds);
+    Proposal dest(domain), source(domain);
+    for (size_t i = 0; i < values.size(); i++) {
+        (i % 2 == 0 ? dest : source).insert(values[i]);
+    }
+
+    for (auto _ : state) {
+        dest.set_union(source);
+        benchmark::DoNotOptimize(dest.size());
+    }
+    set_items(state);
+}
+
+// Reference: the previous std::unordered_set<int> representation
+static void BM_UnorderedSetIsSubset(benchmark::State &state) {
+    auto ds = static_cast<size_t>(state.range(0));
+    auto values = sample_values(ds, static_cast<size_t>(state.range(1)));
+    std::unordered_set<ProposalValue> subset, superset;
+    for (size_t i = 0; i < values.size(); i++) {
+        superset.insert(values[i]);
+        if (i % 2 == 0) { subset.insert(values[i]); }
+    }
+
+    for (auto _ : state) {
+        bool result = std::all_of(subset.begin(), subset.end(), [&](ProposalValue v) { return superset.count(v) > 0; });
+        benchmark::DoNotOptimize(result);
+    }
+    set_items(state);
+}
+
+static void BM_UnorderedSetUnion(benchmark::State &state) {
+    auto ds = static_cast<size_t>(state.range(0));
+    auto values = sample_values(ds, static_cast<size_t>(state.range(1)));
+    std::unordered_set<ProposalValue> dest, source;
+    for (size_t i = 0; i < values.size(); i++) {
+        (i % 2 == 0 ? dest : source).insert(values[i]);
+    }
+
+    for (auto _ : state) {
+        for (auto value : source) { dest.insert(value); }
+        benchmark::DoNotOptimize(dest.size());
+    }
+    set_items(state);
+}
+
+// Wire size of a propose record and of the nack it triggers (accepted holds one extra value)
+static void BM_ProposalMessageEncode(benchmark::State &state) {
+    auto ds = static_cast<size_t>(state.range(0));
+    auto values = sample_values(ds, static_cast<size_t>(state.range(1)));
+    ProposalDomain domain(ds);
+    Proposal proposal(domain), accepted(domain);
+    for (auto value : values) { proposal.insert(value); accepted.insert(value); }
+    accepted.insert(static_cast<ProposalValue>(ds + 1));
+
+    size_t propose_bytes = 0, nack_bytes = 0;
+    std::unique_ptr<char[]> buffer;
+    for (auto _ : state) {
+        ProposalMessage propose(0, 1, proposal);
+        ProposalMessage nack = ProposalMessage::create_nack(propose, accepted);
+        propose_bytes = propose.record_length();
+        nack_bytes = nack.record_length();
+        if (!buffer) { buffer.reset(new char[propose_bytes]); }
+        size_t offset = 0;
+        propose.serialize_record(buffer.get(), offset);
+        benchmark::DoNotOptimize(buffer.get());
+    }
+    set_items(state);
+    state.counters["propose_bytes"] = static_cast<double>(propose_bytes);
+    state.counters["nack_bytes"] = static_cast<double>(nack_bytes);
+    state.counters["raw_bytes"] = static_cast<double>(sizeof(ProposalValue) * proposal.size());
+}
+
+// Decoding a propose record into the receiver's domain (elements = 16384 of 2^20 stays sparse)
+static void BM_ProposalMessageDecode(benchmark::State &state) {
+    auto ds = static_cast<size_t>(state.range(0));
+    auto values = sample_values(ds, static_cast<size_t>(state.range(1)));
+    ProposalDomain domain(ds), receiver(ds);
+    Proposal proposal(domain);
+    proposal.insert(values.data(), values.size());
+
+    ProposalMessage propose(0, 1, proposal);
+    std::unique_ptr<char[]> buffer(new char[propose.record_length()]);
+    size_t length = 0;
+    propose.serialize_record(buffer.get(), length);
+    for (auto _ : state) {
+        size_t offset = 0;
+        ProposalMessage decoded(buffer.get(), offset, receiver);
+        benchmark::DoNotOptimize(decoded.get_proposal().size());
+    }
+    set_items(state);
+}
+
+static void proposal_args(benchmark::internal::Benchmark *b) {
+    for (int64_t ds : {1 << 10, 1 << 16, 1 << 20}) {
+        b->Args({ds, 16});
+        b->Args({ds, ds / 2});
+    }
+}
+
+BENCHMARK(BM_ProposalIsSubset)->Apply(proposal_args);
+BENCHMARK(BM_ProposalUnion)->Apply(proposal_args);
+BENCHMARK(BM_UnorderedSetIsSubset)->Apply(proposal_args);
+BENCHMARK(BM_UnorderedSetUnion)->Apply(proposal_args);
+BENCHMARK(BM_ProposalMessageEncode)->Apply(proposal_args);
+BENCHMARK(BM_ProposalMessageDecode)->Apply(proposal_args)->Args({1 << 20, 1 << 14});
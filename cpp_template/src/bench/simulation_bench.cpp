@@ -0,0 +1,278 @@
+// ReceiveBuffer inlined at -O3 trips -Wstrict-overflow=5 (see delivery_bench.cpp)
+#pragma GCC diagnostic ignored "-Wstrict-overflow"
+
+// C++ standard library headers
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+
+// C system headers
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// Benchmark headers
+#include <benchmark/benchmark.h>
+
+// Project headers
+#include "types.hpp"
+#include "proposal.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+#include "metrics.hpp"
+#include "latency.hpp"
+#include "simulation.hpp"
+#include "best_effort_broadcast.hpp"
+#include "fifo_uniform_reliable_broadcast.hpp"
+#include "lattice_agreement.hpp"
+
+/**
+ * @brief Message complexity of the protocols, in a discrete-event simulation
+ *
+ * @details Runs whole clusters on virtual time on one thread (see
+ * Simulation), so 128 hosts finish in seconds and every run with the same
+ * args sends exactly the same packets. Args are (nodes, messages or rounds
+ * per node, loss in percent, one-way delay in microseconds, jitter is a
+ * quarter of the delay). Reports packets and bytes per delivered message or
+ * decision, the virtual time to finish and virtual latency percentiles; the
+ * wall time is the cost of the simulation itself. A last arg of 1 relays
+ * broadcasts along a tree (BebMode::Tree).
+ */
+#define SIM_SEED 42
+#define SIM_TIME_LIMIT_NS (600ULL * 1000000000) // Virtual time after which a run counts as stuck
+static const size_t PROPOSAL_SIZE = 10;
+static const int DISTINCT_ELEMENTS = 100;
+
+static std::vector<Host> sim_hosts(size_t nodes) {
+    std::vector<Host> hosts;
+    for (size_t id = 1; id <= nodes; id++) {
+        hosts.emplace_back(id, Address("127.0.0.1", static_cast<uint16_t>(30000 + id))); // Never bound
+    }
+    return hosts;
+}
+
+static BebMode sim_beb_mode(const benchmark::State &state, int arg) {
+    return state.range(arg) != 0 ? BebMode::Tree : BebMode::Direct;
+}
+
+static LinkConditions sim_conditions(const benchmark::State &state) {
+    LinkConditions conditions;
+    conditions.loss = static_cast<double>(state.range(2)) / 100;
+    conditions.delay_us = static_cast<uint64_t>(state.range(3));
+    conditions.jitter_us = conditions.delay_us / 4;
+    return conditions;
+}
+
+/**
+ * @brief Network counters over one simulated run
+ */
+class NetworkCost {
+private:
+    uint64_t packets, bytes;
+
+public:
+    NetworkCost() : packets(Metrics::instance().total(Counter::PacketsSent)), bytes(Metrics::instance().total(Counter::BytesSent)) {}
+
+    void report(benchmark::State &state, size_t deliveries, uint64_t virtual_ns, const LatencyHistogram &latency) {
+        double packets = static_cast<double>(Metrics::instance().total(Counter::PacketsSent) - this->packets);
+        double bytes = static_cast<double>(Metrics::instance().total(Counter::BytesSent) - this->bytes);
+        state.counters["packets_per_delivery"] = packets / static_cast<double>(deliveries);
+        state.counters["bytes_per_delivery"] = bytes / static_cast<double>(deliveries);
+        state.counters["virtual_ms"] = static_cast<double>(virtual_ns) / 1e6;
+        state.counters["p50_us"] = static_cast<double>(latency.percentile(0.5)) / 1000;
+        state.counters["p99_us"] = static_cast<double>(latency.percentile(0.99)) / 1000;
+    }
+};
+
+static void BM_SimulatedFifo(benchmark::State &state) {
+    auto nodes = static_cast<size_t>(state.range(0));
+    auto messages = static_cast<size_t>(state.range(1));
+
+    for (auto _ : state) {
+        NetworkCost cost;
+        LatencyHistogram latency;
+        Hosts hosts(sim_hosts(nodes));
+        Simulation simulation(hosts, sim_conditions(state), SIM_SEED);
+        Transport::set_factory(simulation.factory());
+
+        // Broadcasts all start at virtual time 0
+        size_t delivered = 0;
+        std::vector<std::unique_ptr<FIFOUniformReliableBroadcast>> frbs;
+        for (const auto &host : hosts) {
+            frbs.emplace_back(new FIFOUniformReliableBroadcast(host, hosts, [&](BroadcastMessage) noexcept {
+                latency.record(simulation.now());
+                delivered++;
+            }, sim_beb_mode(state, 4)));
+        }
+        simulation.schedule(0, [&]() noexcept {
+            for (size_t i = 1; i <= messages; i++) {
+                for (auto &frb : frbs) {
+                    StringMessage m(std::to_string(i));
+                    frb->broadcast(m);
+                }
+            }
+        });
+        bool done = simulation.run([&]() noexcept { return delivered == nodes * nodes * messages; }, SIM_TIME_LIMIT_NS);
+        uint64_t virtual_ns = simulation.now();
+        state.counters["events"] = static_cast<double>(simulation.get_events_run());
+
+        frbs.clear();
+        Transport::set_factory(nullptr);
+        if (!done) {
+            state.SkipWithError("Simulation stuck before all deliveries");
+            break;
+        }
+        cost.report(state, delivered, virtual_ns, latency);
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * nodes * nodes * messages));
+}
+
+/**
+ * @brief Cost of one best-effort broadcaster among many
+ *
+ * @details Host 1 broadcasts every message to all hosts, directly or along a
+ * tree. Reports what the originator pays per message (datagrams, bytes and
+ * CPU time in its events) against the busiest other host.
+ */
+static void BM_SimulatedBroadcast(benchmark::State &state) {
+    auto nodes = static_cast<size_t>(state.range(0));
+    auto messages = static_cast<size_t>(state.range(1));
+
+    for (auto _ : state) {
+        Hosts hosts(sim_hosts(nodes));
+        Simulation simulation(hosts, sim_conditions(state), SIM_SEED);
+        Transport::set_factory(simulation.factory());
+
+        size_t delivered = 0;
+        std::vector<std::unique_ptr<BestEffortBroadcast>> bebs;
+        for (const auto &host : hosts) {
+            bebs.emplace_back(new BestEffortBroadcast(host, hosts, [&](TransportMessage) noexcept { delivered++; }, sim_beb_mode(state, 4)));
+        }
+        simulation.schedule(1, 0, [&]() noexcept {
+            for (size_t i = 1; i <= messages; i++) {
+                StringMessage m(std::to_string(i));
+                bebs[0]->broadcast(m);
+            }
+        });
+        bool done = simulation.run([&]() noexcept { return delivered == nodes * messages; }, SIM_TIME_LIMIT_NS);
+        uint64_t virtual_ns = simulation.now();
+
+        auto per_message = [&](uint64_t value) { return static_cast<double>(value) / static_cast<double>(messages); };
+        const auto &origin = simulation.get_cost(1);
+        uint64_t busiest_packets = 0, busiest_ns = 0;
+        for (size_t id = 2; id <= nodes; id++) {
+            busiest_packets = std::max(busiest_packets, simulation.get_cost(id).packets_sent);
+            busiest_ns = std::max(busiest_ns, simulation.get_cost(id).busy_ns);
+        }
+        state.counters["origin_packets"] = per_message(origin.packets_sent);
+        state.counters["origin_bytes"] = per_message(origin.bytes_sent);
+        state.counters["origin_cpu_us"] = per_message(origin.busy_ns) / 1000;
+        state.counters["busiest_other_packets"] = per_message(busiest_packets);
+        state.counters["busiest_other_cpu_us"] = per_message(busiest_ns) / 1000;
+        state.counters["virtual_ms"] = static_cast<double>(virtual_ns) / 1e6;
+
+        bebs.clear();
+        Transport::set_factory(nullptr);
+        if (!done) {
+            state.SkipWithError("Simulation stuck before all deliveries");
+            break;
+        }
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * nodes * messages));
+}
+
+static void BM_SimulatedLattice(benchmark::State &state) {
+    auto nodes = static_cast<size_t>(state.range(0));
+    auto rounds = static_cast<size_t>(state.range(1));
+
+    // Silence the protocol's stdout tracing
+    std::cout.setstate(std::ios::failbit);
+    for (auto _ : state) {
+        NetworkCost cost;
+        LatencyHistogram latency;
+        Hosts hosts(sim_hosts(nodes));
+        Simulation simulation(hosts, sim_conditions(state), SIM_SEED);
+        Transport::set_factory(simulation.factory());
+
+        // Every node keeps LA_DEFAULT_WINDOW rounds in flight, proposing the next one as a round is decided
+        std::vector<size_t> proposed(nodes, 0), decided_rounds(nodes, 0);
+        std::vector<uint64_t> proposed_at(nodes * rounds, 0);
+        size_t decided = 0;
+        std::vector<std::unique_ptr<ProposalDomain>> domains;
+        std::vector<std::unique_ptr<LatticeAgreement>> las;
+        std::mt19937 rng(SIM_SEED);
+        std::uniform_int_distribution<int> values(1, DISTINCT_ELEMENTS);
+        std::function<void(size_t)> propose = [&](size_t i) {
+            size_t round = proposed[i]++;
+            Proposal proposal(*domains[i]);
+            for (size_t j = 0; j < PROPOSAL_SIZE; j++) { proposal.insert(values(rng)); }
+            proposed_at[i * rounds + round] = simulation.now();
+            las[i]->propose(round, proposal);
+            las[i]->flush();
+        };
+        for (size_t i = 0; i < nodes; i++) {
+            domains.emplace_back(new ProposalDomain(DISTINCT_ELEMENTS));
+            las.emplace_back(new LatticeAgreement(hosts.get_hosts()[i], hosts, *domains.back(), [&, i](Proposal) noexcept {
+                size_t round = decided_rounds[i]++;
+                latency.record(simulation.now() - proposed_at[i * rounds + round]);
+                decided++;
+                // Outside the callback, it runs in the middle of a delivery
+                simulation.schedule(0, [&, i]() noexcept {
+                    if (proposed[i] < rounds) { propose(i); }
+                });
+            }));
+        }
+        simulation.schedule(0, [&]() noexcept {
+            for (size_t i = 0; i < nodes; i++) {
+                while (proposed[i] < std::min<size_t>(rounds, LA_DEFAULT_WINDOW)) { propose(i); }
+            }
+        });
+        bool done = simulation.run([&]() noexcept { return decided == nodes * rounds; }, SIM_TIME_LIMIT_NS);
+        uint64_t virtual_ns = simulation.now();
+        state.counters["events"] = static_cast<double>(simulation.get_events_run());
+
+        las.clear();
+        Transport::set_factory(nullptr);
+        if (!done) {
+            state.SkipWithError("Simulation stuck before all decisions");
+            break;
+        }
+        cost.report(state, decided, virtual_ns, latency);
+    }
+    std::cout.clear();
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * nodes * rounds));
+}
+
+BENCHMARK(BM_SimulatedFifo)
+    ->ArgNames({"nodes", "messages", "loss", "delay_us", "tree"})
+    ->Args({3, 10000, 0, 100, 0})->Args({3, 10000, 10, 100, 0})->Args({32, 100, 0, 100, 0})->Args({32, 100, 0, 100, 1})
+    ->Args({128, 1, 0, 100, 0})
+    ->Unit(benchmark::kMillisecond)->Iterations(1);
+
+BENCHMARK(BM_SimulatedBroadcast)
+    ->ArgNames({"nodes", "messages", "loss", "delay_us", "tree"})
+    ->Args({128, 1000, 0, 100, 0})->Args({128, 1000, 0, 100, 1})->Args({128, 1000, 10, 100, 0})->Args({128, 1000, 10, 100, 1})
+    ->Unit(benchmark::kMillisecond)->Iterations(1);
+
+BENCHMARK(BM_SimulatedLattice)
+    ->ArgNames({"nodes", "rounds", "loss", "delay_us"})
+    ->Args({3, 10000, 0, 100})->Args({3, 10000, 10, 100})->Args({32, 100, 0, 100})->Args({128, 5, 0, 100})
+    ->Unit(benchmark::kMillisecond)->Iterations(1);
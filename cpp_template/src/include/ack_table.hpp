@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include "bitset_ops.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+
+#define ACK_TABLE_WORDS 4 // Bitmap words per message, so host IDs below 256
+#define ACK_TABLE_MAX_DIRECT (1 << 16) // Entries of a source's window in its deque, messages further ahead go to a map
+
+/**
+ * @brief URB bookkeeping of acknowledgements, one host bitmap per message
+ *
+ * @details For every source, messages in a window starting at the first one
+ * not delivered yet, each with the bitmap of hosts that relayed it (acked),
+ * whether it is pending (seen, relayed by us) and whether it was delivered.
+ * The window moves past delivered messages, so it only spans messages in
+ * flight. apply() takes the (sender, message) events of one received batch
+ * under a single lock: it sets the senders' bits in a per-message delta, ORs
+ * each delta into the message's bitmap (bitset_ops::set_union, AVX2 when
+ * available) which also counts the bits, and returns the messages seen for the
+ * first time (to relay) and the ones a majority now acks (to deliver).
+ *
+ * The deque spans at most ACK_TABLE_MAX_DIRECT messages past the first
+ * undelivered one of the source. Messages further ahead get an entry in a map
+ * of the window instead, and move to the deque once the window reaches them,
+ * so memory follows the messages received rather than the gap in sequence
+ * numbers (a far-ahead or bogus sequence number costs one map node). Nothing
+ * is dropped: perfect links acked every message already.
+ */
+class AckTable {
+public:
+    struct Event {
+        size_t sender_id;
+        BroadcastMessage bm;
+    };
+
+private:
+    struct Entry {
+        uint64_t acks[ACK_TABLE_WORDS] = {};
+        bool pending{false};
+        bool delivered{false};
+        size_t touched{0}; // 1 + index of the entry's delta in the current batch, 0 if untouched
+        std::optional<BroadcastMessage> message; // Until delivered
+    };
+
+    struct Window {
+        size_t base{SEQ_NUM_INIT}; // Sequence number of entries.front()
+        std::deque<Entry> entries; // At most ACK_TABLE_MAX_DIRECT
+        std::map<size_t, Entry> ahead; // By sequence number, past the deque
+    };
+
+    struct Delta {
+        Entry *entry;
+        uint64_t acks[ACK_TABLE_WORDS];
+    };
+
+    std::vector<Window> windows; // By source ID
+    size_t threshold; // Majority of the hosts
+    std::mutex lock;
+
+    // Entry of a message, nullptr if it was delivered and left the window (stays valid until advance())
+    Entry *find(size_t source_id, size_t seq_number) {
+        Window &window = this->windows[source_id];
+        if (seq_number < window.base) { return nullptr; }
+        size_t offset = seq_number - window.base;
+        if (offset >= ACK_TABLE_MAX_DIRECT) { return &window.ahead[seq_number]; }
+        if (offset >= window.entries.size()) { window.entries.resize(offset + 1); }
+        return &window.entries[offset];
+    }
+
+    // Move the window past delivered messages, taking in the entries it now reaches from the map
+    void advance(size_t source_id) {
+        Window &window = this->windows[source_id];
+        while (true) {
+            while (!window.entries.empty() && window.entries.front().delivered) {
+                window.entries.pop_front();
+                window.base++;
+            }
+            if (window.ahead.empty() || window.ahead.begin()->first >= window.base + ACK_TABLE_MAX_DIRECT) { return; }
+
+            auto node = window.ahead.begin();
+            size_t offset = node->first - window.base;
+            if (offset >= window.entries.size()) { window.entries.resize(offset + 1); }
+            window.entries[offset] = std::move(node->second);
+            window.ahead.erase(node);
+        }
+    }
+
+public:
+    AckTable(const Hosts &hosts) : windows(hosts.get_id_bound()), threshold(hosts.get_host_count() / 2 + 1) {
+        if (hosts.get_id_bound() > ACK_TABLE_WORDS * 64) {
+            throw std::runtime_error("Host IDs must be below " + std::to_string(ACK_TABLE_WORDS * 64));
+        }
+    }
+
+    // Our own broadcast: pending (not relayed again on receipt), acked by nobody yet
+    void broadcast(const BroadcastMessage &bm) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        Entry *entry = this->find(bm.get_source_id(), bm.get_seq_number());
+        entry->pending = true;
+        entry->message = bm;
+    }
+
+    void apply(std::vector<Event> &events, std::vector<BroadcastMessage> &relays, std::vector<BroadcastMessage> &deliveries) {
+        std::vector<Delta> deltas;
+        deltas.reserve(events.size());
+
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (auto &event : events) {
+            size_t source_id = event.bm.get_source_id();
+            Entry *entry = this->find(source_id, event.bm.get_seq_number());
+            if (entry == nullptr || entry->delivered) { continue; }
+
+            if (!entry->pending) {
+                entry->pending = true;
+                entry->message = event.bm;
+                relays.push_back(std::move(event.bm));
+            }
+            if (entry->touched == 0) {
+                deltas.push_back(Delta{entry, {}});
+                entry->touched = deltas.size();
+            }
+            deltas[entry->touched - 1].acks[event.sender_id / 64] |= uint64_t(1) << (event.sender_id % 64);
+        }
+
+        for (auto &delta : deltas) {
+            Entry *entry = delta.entry;
+            entry->touched = 0;
+            if (bitset_ops::set_union(entry->acks, delta.acks, ACK_TABLE_WORDS) >= this->threshold) {
+                entry->delivered = true;
+                deliveries.push_back(std::move(*entry->message));
+                entry->message.reset();
+            }
+        }
+        for (const auto &bm : deliveries) { this->advance(bm.get_source_id()); }
+    }
+};
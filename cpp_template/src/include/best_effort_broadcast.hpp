@@ -2,45 +2,327 @@
 
 #include <iostream>
 #include <functional>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
 
 #include "hosts.hpp"
+#include "log.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include "perfect_link.hpp"
+#include "thread_placement.hpp"
+
+#define BEB_DEFAULT_FANOUT 4 // Tree mode: children per node
+#define BEB_ANTI_ENTROPY_MS 100 // Tree mode: interval between digests
+#define BEB_DIGEST_PEERS 3 // Tree mode: random peers that get a digest per interval
+#define BEB_REPAIR_BATCH 256 // Tree mode: messages resent per digest at most
+#define BEB_STALL_MS 1000 // Tree mode: an originator silent on the tree for this long gets repaired
+
+// How BestEffortBroadcast::broadcast() reaches the other hosts
+enum class BebMode {
+    Direct, // The originator sends to every host
+    Tree, // Along a spanning tree rooted at the originator, with anti-entropy
+};
 
 /**
  * @brief Best-Effort Broadcast (BEB) using Perfect Link (PL)
- * 
+ *
  * @details Supports broadcasting a message to all processes in the system
- * and delivery of messages to all processes in the system. Satisfies the 
+ * and delivery of messages to all processes in the system. Satisfies the
  * best-effort properties:
- * - (BEB1: Validity) If process p sends message m, then every correct process 
+ * - (BEB1: Validity) If process p sends message m, then every correct process
  *   eventually delivers m.
  * - (BEB2: No Duplication) No message is delivered more than once.
- * - (BEB3: No Creation) If a process delivers a message m, then m must have been 
+ * - (BEB3: No Creation) If a process delivers a message m, then m must have been
  *   sent by some process.
+ *
+ * In Direct mode the originator sends m to every host, O(N) sends and
+ * retransmit state per message. In Tree mode it sends m to `fanout` children
+ * of the k-ary tree over the hosts (in file order) rooted at itself, and each
+ * host forwards m to its own children on first receipt, so every host sends
+ * at most `fanout` copies. Deliveries look the same as in Direct mode (sender
+ * is the originator). A crashed interior host would cut its subtree off, so
+ * every BEB_ANTI_ENTROPY_MS each host sends a digest (the first sequence
+ * number it has not delivered, per originator) to BEB_DIGEST_PEERS random
+ * peers. The digest also lists the originators from which nothing has come
+ * down the tree (from the host's parent) for BEB_STALL_MS, and only for
+ * those do the peers reply with the messages beyond it (others may merely
+ * still be travelling down a busy tree). A host cut off by a crash is
+ * therefore repaired by the first digest that reaches a peer holding its
+ * messages: within about BEB_STALL_MS plus one interval and a round trip
+ * (1.1 s plus RTT), independent of the number of hosts, and keeps being
+ * repaired every interval while the tree stays cut.
+ *
+ * A message is held until every host's digest covers it. Crashed hosts never
+ * send one, so while a host is down `held` grows with every message, like
+ * PL's retransmission queue towards it: dropping any could leave a cut off
+ * host without repairs. send() is a plain PL send in both modes.
  */
 class BestEffortBroadcast {
 private:
-    Hosts hosts;
-    PerfectLink pl;
+    // Tree mode: a delivered message kept for repairs
+    struct Held {
+        std::shared_ptr<char[]> payload;
+        size_t length;
+    };
+
+    // Tree mode: messages from one originator
+    struct Origin {
+        uint32_t prefix{0}; // All sequence numbers below were delivered
+        std::set<uint32_t> beyond; // Delivered above the prefix
+        std::map<uint32_t, Held> held;
+        uint64_t tree_round{0}; // Last anti-entropy round a message came from the parent
+    };
+
+    Host host;
+    const Hosts &hosts;
+    std::function<void(std::vector<TransportMessage>)> bebDeliver; // Called once per received batch
+    BebMode mode;
+    size_t fanout;
+    std::vector<size_t> index; // Position in file order, by host ID
+    std::vector<Origin> origins; // By originator ID
+    std::vector<std::vector<uint32_t>> known; // Last digest received from each host, by host ID
+    std::atomic<uint32_t> next_seq_number{0};
+    uint64_t round{0}; // Anti-entropy rounds so far
+    std::mt19937 rng; // Picks the digest receivers
+    std::mutex lock; // Guards the tree mode state above
+    std::condition_variable stopped;
+    bool stopping{false};
+    std::thread anti_entropy_thread;
+    PerfectLink pl; // Last, starts delivering before the constructor returns
+
+    void plDeliver(std::vector<TransportMessage> tms) {
+        if (this->mode == BebMode::Tree) {
+            std::vector<TransportMessage> delivered;
+            for (auto &tm : tms) { this->receive(std::move(tm), delivered); }
+            tms = std::move(delivered);
+        }
+        if (!tms.empty()) {
+            TRACE_SPAN("bebDeliver", tms.size());
+            this->bebDeliver(std::move(tms));
+        }
+    }
+
+    // Tree mode: handle one received message, adding what it delivers to `delivered`
+    void receive(TransportMessage tm, std::vector<TransportMessage> &delivered) {
+        Message::Type type;
+        std::memcpy(&type, tm.get_payload().get(), sizeof(type));
+        if (type != Message::Type::Dissemination) {
+            delivered.push_back(std::move(tm));
+            return;
+        }
+
+        DisseminationMessage dm(tm.get_payload());
+        if (dm.get_kind() == DisseminationMessage::Kind::Digest) {
+            this->repair(dm, tm.get_sender());
+            return;
+        }
+
+        // First receipt: forward down the tree, then deliver as if sent by the originator
+        const Host &origin = this->hosts.get_host(dm.get_origin_id());
+        auto seq_number = static_cast<uint32_t>(dm.get_seq_number());
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            Origin &state = this->origins[origin.get_id()];
+            if (seq_number < state.prefix || !state.beyond.insert(seq_number).second) {
+                return;
+            }
+            while (!state.beyond.empty() && *state.beyond.begin() == state.prefix) {
+                state.beyond.erase(state.beyond.begin());
+                state.prefix++;
+            }
+            if (tm.get_sender().get_id() == this->parent(origin).get_id()) { state.tree_round = this->round; }
+            state.held[seq_number] = Held{dm.get_payload(), dm.get_length()};
+        }
+        for (const Host &child : this->children(origin)) {
+            Metrics::add(Counter::BebForwards);
+            this->pl.send(dm, child);
+        }
+
+        delivered.emplace_back(TransportMessage::Type::Data, origin, this->host, dm.get_seq_number(), dm.get_payload(), dm.get_length());
+    }
+
+    // Parent of this host in the tree rooted at `origin` (the origin itself for the root)
+    const Host &parent(const Host &origin) const {
+        const auto &all = this->hosts.get_hosts();
+        size_t count = all.size(), root = this->index[origin.get_id()];
+        size_t rank = (this->index[this->host.get_id()] + count - root) % count;
+        return rank == 0 ? origin : all[(root + (rank - 1) / this->fanout) % count];
+    }
+
+    // Children of this host in the tree rooted at `origin`
+    std::vector<Host> children(const Host &origin) const {
+        const auto &all = this->hosts.get_hosts();
+        size_t count = all.size(), root = this->index[origin.get_id()];
+        size_t rank = (this->index[this->host.get_id()] + count - root) % count;
+
+        std::vector<Host> children;
+        for (size_t child = rank * this->fanout + 1; child <= rank * this->fanout + this->fanout && child < count; child++) {
+            children.push_back(all[(root + child) % count]);
+        }
+        return children;
+    }
+
+    // Resend what `peer` has not delivered from its stalled originators, according to its digest
+    void repair(const DisseminationMessage &digest, const Host &peer) {
+        std::vector<DisseminationMessage> repairs;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            const auto &prefixes = digest.get_prefixes();
+            this->known[peer.get_id()] = prefixes;
+            for (uint32_t origin_id : digest.get_stalled()) {
+                if (origin_id >= prefixes.size() || origin_id >= this->origins.size()) { continue; }
+                Origin &state = this->origins[origin_id];
+                for (auto it = state.held.lower_bound(prefixes[origin_id]); it != state.held.end() && repairs.size() < BEB_REPAIR_BATCH; ++it) {
+                    repairs.emplace_back(origin_id, it->first, it->second.payload, it->second.length);
+                }
+            }
+        }
+        for (auto &dm : repairs) {
+            Metrics::add(Counter::BebRepairs);
+            this->pl.send(dm, peer);
+        }
+    }
+
+    // One anti-entropy round: drop messages every host has, send a digest to random peers
+    void anti_entropy() {
+        std::vector<uint32_t> prefixes(this->origins.size(), 0), stalled;
+        std::vector<Host> peers;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->round++;
+            for (const auto &origin : this->hosts) {
+                Origin &state = this->origins[origin.get_id()];
+                prefixes[origin.get_id()] = state.prefix;
+                if ((this->round - state.tree_round) * BEB_ANTI_ENTROPY_MS >= BEB_STALL_MS) {
+                    stalled.push_back(static_cast<uint32_t>(origin.get_id()));
+                }
+
+                uint32_t everywhere = state.prefix;
+                for (const auto &other : this->hosts) {
+                    if (other.get_id() == this->host.get_id()) { continue; }
+                    const auto &digest = this->known[other.get_id()];
+                    everywhere = std::min(everywhere, origin.get_id() < digest.size() ? digest[origin.get_id()] : 0u);
+                }
+                state.held.erase(state.held.begin(), state.held.lower_bound(everywhere));
+            }
+
+            // Reservoir sample of the other hosts
+            size_t seen = 0;
+            for (const auto &other : this->hosts) {
+                if (other.get_id() == this->host.get_id()) { continue; }
+                size_t slot = seen++;
+                if (slot >= BEB_DIGEST_PEERS) { slot = std::uniform_int_distribution<size_t>(0, slot)(this->rng); }
+                if (slot < peers.size()) {
+                    peers[slot] = other;
+                } else if (slot < BEB_DIGEST_PEERS) {
+                    peers.push_back(other);
+                }
+            }
+        }
+        if (!peers.empty()) {
+            DisseminationMessage digest(std::move(prefixes), std::move(stalled));
+            for (const auto &peer : peers) {
+                Metrics::add(Counter::BebDigests);
+                this->pl.send(digest, peer);
+            }
+        }
+    }
+
+    void schedule_anti_entropy() {
+        this->pl.schedule(static_cast<uint64_t>(BEB_ANTI_ENTROPY_MS) * 1000000, [this]() {
+            if (this->stopping) { return; }
+            this->anti_entropy();
+            this->schedule_anti_entropy();
+        });
+    }
+
+    std::thread start_anti_entropy() {
+        return std::thread([this]() {
+            ThreadPlacement::place("beb-ae-" + std::to_string(this->host.get_id()));
+            std::unique_lock<std::mutex> guard(this->lock);
+            while (!this->stopped.wait_for(guard, std::chrono::milliseconds(BEB_ANTI_ENTROPY_MS), [this]() { return this->stopping; })) {
+                guard.unlock();
+                this->anti_entropy();
+                guard.lock();
+            }
+        });
+    }
+
+    void stop_anti_entropy() {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+        }
+        this->stopped.notify_all();
+        if (this->anti_entropy_thread.joinable()) { this->anti_entropy_thread.join(); }
+    }
 
 public:
-    BestEffortBroadcast(Host local_host, Hosts hosts, std::function<void(TransportMessage)> bebDeliver) :
-        hosts(hosts), pl(local_host, hosts, bebDeliver) {}
+    // Deliver one message at a time
+    BestEffortBroadcast(Host local_host, const Hosts &hosts, std::function<void(TransportMessage)> bebDeliver,
+                        BebMode mode = BebMode::Direct, size_t fanout = BEB_DEFAULT_FANOUT) :
+        BestEffortBroadcast(local_host, hosts, std::function<void(std::vector<TransportMessage>)>([bebDeliver](std::vector<TransportMessage> tms) {
+            for (auto &tm : tms) { bebDeliver(std::move(tm)); }
+        }), mode, fanout) {}
+
+    // Deliver the messages of each received batch at once
+    BestEffortBroadcast(Host local_host, const Hosts &hosts, std::function<void(std::vector<TransportMessage>)> bebDeliver,
+                        BebMode mode = BebMode::Direct, size_t fanout = BEB_DEFAULT_FANOUT) :
+        host(local_host), hosts(hosts), bebDeliver(bebDeliver), mode(mode), fanout(fanout),
+        index(hosts.get_id_bound(), 0), origins(mode == BebMode::Tree ? hosts.get_id_bound() : 0), known(origins.size()), rng(static_cast<unsigned>(local_host.get_id())),
+        pl(local_host, hosts, [this](std::vector<TransportMessage> tms) { this->plDeliver(std::move(tms)); }) {
+        if (fanout == 0) {
+            throw std::runtime_error("BEB fanout must be positive");
+        }
+        for (size_t i = 0; i < hosts.get_host_count(); i++) {
+            this->index[hosts.get_hosts()[i].get_id()] = i;
+        }
+        if (mode == BebMode::Tree) {
+            if (this->pl.is_event_driven()) {
+                this->schedule_anti_entropy();
+            } else {
+                this->anti_entropy_thread = this->start_anti_entropy();
+            }
+        }
+    }
+
+    ~BestEffortBroadcast() {
+        this->stop_anti_entropy();
+    }
 
     void broadcast(Message &m) {
-        std::cout << "bebBroadcast: " << m << std::endl;
-        for (auto host : this->hosts.get_hosts()) {
+        LOG_TRACE("bebBroadcast: " << m);
+        Metrics::add(Counter::BebBroadcasts);
+        if (this->mode == BebMode::Tree) {
+            // Through our own PL, so the originator delivers and forwards on the receiving thread like everyone else
+            size_t length = 0;
+            auto payload = m.serialize(length);
+            DisseminationMessage dm(this->host.get_id(), this->next_seq_number++, std::move(payload), length);
+            this->pl.send(dm, this->host);
+            return;
+        }
+        for (const auto &host : this->hosts) {
             this->pl.send(m, host);
         }
     }
 
-    void send(Message &m, Host host) {
-        std::cout << "bebSend: " << m << " to " << host << std::endl;
+    void send(Message &m, const Host &host) {
+        LOG_TRACE("bebSend: " << m << " to " << host);
         this->pl.send(m, host);
     }
 
+    bool is_event_driven() const { return this->pl.is_event_driven(); }
+
     void shutdown() {
+        this->stop_anti_entropy();
         this->pl.shutdown();
     }
 };
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include <immintrin.h>
+
+/**
+ * @brief Word-level operations on bitsets of n uint64_t words
+ *
+ * @details Each operation picks an AVX2 version at run time when the CPU has
+ * it, a scalar loop otherwise. Used by dense proposals and the URB ack table.
+ */
+namespace bitset_ops {
+    inline bool has_avx2() {
+        static const bool result = __builtin_cpu_supports("avx2");
+        return result;
+    }
+
+    // dest |= source over n words, returns the popcount of dest
+    __attribute__((target("avx2,popcnt")))
+    inline size_t union_avx2(uint64_t *dest, const uint64_t *source, size_t n) {
+        size_t count = 0, i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dest + i));
+            __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(source + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), _mm256_or_si256(d, s));
+            count += static_cast<size_t>(__builtin_popcountll(dest[i]) + __builtin_popcountll(dest[i + 1]) +
+                                         __builtin_popcountll(dest[i + 2]) + __builtin_popcountll(dest[i + 3]));
+        }
+        for (; i < n; i++) {
+            dest[i] |= source[i];
+            count += static_cast<size_t>(__builtin_popcountll(dest[i]));
+        }
+        return count;
+    }
+
+    inline size_t union_scalar(uint64_t *dest, const uint64_t *source, size_t n) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            dest[i] |= source[i];
+            count += static_cast<size_t>(__builtin_popcountll(dest[i]));
+        }
+        return count;
+    }
+
+    // (subset & ~superset) == 0 over n words
+    __attribute__((target("avx2")))
+    inline bool is_subset_avx2(const uint64_t *subset, const uint64_t *superset, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(subset + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(superset + i));
+            if (!_mm256_testc_si256(b, a)) { return false; }
+        }
+        for (; i < n; i++) {
+            if (subset[i] & ~superset[i]) { return false; }
+        }
+        return true;
+    }
+
+    inline bool is_subset_scalar(const uint64_t *subset, const uint64_t *superset, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            if (subset[i] & ~superset[i]) { return false; }
+        }
+        return true;
+    }
+
+    // dest = a & ~b over n words, returns the popcount of dest
+    __attribute__((target("avx2,popcnt")))
+    inline size_t difference_avx2(uint64_t *dest, const uint64_t *a, const uint64_t *b, size_t n) {
+        size_t count = 0, i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dest + i), _mm256_andnot_si256(vb, va));
+            count += static_cast<size_t>(__builtin_popcountll(dest[i]) + __builtin_popcountll(dest[i + 1]) +
+                                         __builtin_popcountll(dest[i + 2]) + __builtin_popcountll(dest[i + 3]));
+        }
+        for (; i < n; i++) {
+            dest[i] = a[i] & ~b[i];
+            count += static_cast<size_t>(__builtin_popcountll(dest[i]));
+        }
+        return count;
+    }
+
+    inline size_t difference_scalar(uint64_t *dest, const uint64_t *a, const uint64_t *b, size_t n) {
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++) {
+            dest[i] = a[i] & ~b[i];
+            count += static_cast<size_t>(__builtin_popcountll(dest[i]));
+        }
+        return count;
+    }
+
+    inline size_t set_union(uint64_t *dest, const uint64_t *source, size_t n) {
+        return has_avx2() ? union_avx2(dest, source, n) : union_scalar(dest, source, n);
+    }
+
+    inline bool is_subset(const uint64_t *subset, const uint64_t *superset, size_t n) {
+        return has_avx2() ? is_subset_avx2(subset, superset, n) : is_subset_scalar(subset, superset, n);
+    }
+
+    inline size_t difference(uint64_t *dest, const uint64_t *a, const uint64_t *b, size_t n) {
+        return has_avx2() ? difference_avx2(dest, a, b, n) : difference_scalar(dest, a, b, n);
+    }
+}
@@ -2,6 +2,7 @@
 
 #include <queue>
 #include <mutex>
+#include <vector>
 
 template <typename T>
 class ConcurrentQueue {
@@ -26,6 +27,19 @@ public:
         return item;
     }
 
+    // Pop every queued item at once
+    std::vector<T> pop_all() {
+        this->lock.lock();
+        std::vector<T> items;
+        items.reserve(this->queue.size());
+        while (!this->queue.empty()) {
+            items.push_back(std::move(this->queue.front()));
+            this->queue.pop();
+        }
+        this->lock.unlock();
+        return items;
+    }
+
     bool empty() {
         this->lock.lock();
         bool result = this->queue.empty();
@@ -3,8 +3,14 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <cstring>
 
-#include "types.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "proposal.hpp"
 
 /**
  * @brief Configuration class for Perfect Link
@@ -83,47 +89,99 @@ public:
 /**
  * @brief Configuration class for Lattice Agreement (M3)
  * 
- * @details Reads the configuration file and stores the 
+ * @details Maps the configuration file into memory and parses it on demand,
+ * one proposal line per get_next_proposal() call. Integers are scanned by hand
+ * straight from the mapping (no stream, no per-line string), and each line is
+ * inserted into the proposal in bulk, so large proposals become dense bitmaps
+ * without an intermediate set. Lines past the end of the file are empty.
 */
 class LatticeAgreementConfig
 {
 private:
-    std::ifstream file;
+    const char *data; // Mapped file contents
+    size_t length;
+    const char *cursor; // Start of the next unread line
     size_t num_rounds; // Number of rounds
     size_t max_proposal_size; // Maximum number of elements per proposal
     size_t num_distinct_elements; // Maximum number of distinct elements
-    std::vector<Proposal> proposals; // List of proposal sets
+    std::vector<ProposalValue> values; // Scratch space for the current line
+
+    // Parse the integers of the line starting at p, returns the start of the next line
+    const char *parse_line(const char *p, std::vector<ProposalValue> &out) const {
+        const char *end = this->data + this->length;
+        auto newline = static_cast<const char *>(std::memchr(p, '\n', static_cast<size_t>(end - p)));
+        const char *line_end = newline != nullptr ? newline : end;
+
+        while (p < line_end) {
+            // Skip separators
+            while (p < line_end && *p != '-' && static_cast<unsigned>(*p - '0') >= 10) { p++; }
+            if (p == line_end) { break; }
+
+            bool negative = *p == '-';
+            if (negative) { p++; }
+            int64_t value = 0;
+            unsigned digit;
+            while (p < line_end && (digit = static_cast<unsigned>(*p - '0')) < 10) {
+                value = value * 10 + digit;
+                p++;
+            }
+            out.push_back(static_cast<ProposalValue>(negative ? -value : value));
+        }
+        return newline != nullptr ? newline + 1 : end;
+    }
 
 public:
 
-    LatticeAgreementConfig(const std::string &file_name): file(file_name)
+    LatticeAgreementConfig(const std::string &file_name)
     {
-        // Read config values
-        if (!(file >> num_rounds >> max_proposal_size >> num_distinct_elements)) {
+        int fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("Failed to open config file: " + file_name);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read value from config file");
+        }
+        this->length = static_cast<size_t>(info.st_size);
+        void *mapping = ::mmap(nullptr, this->length, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            throw std::runtime_error("Failed to map config file: " + file_name);
+        }
+        ::madvise(mapping, this->length, MADV_SEQUENTIAL);
+        this->data = static_cast<const char *>(mapping);
+
+        // Read config values, the rest of the header line is ignored
+        this->cursor = this->parse_line(this->data, this->values);
+        if (this->values.size() < 3 || this->values[0] < 0 || this->values[1] < 0 || this->values[2] < 0) {
+            ::munmap(mapping, this->length);
             throw std::runtime_error("Failed to read value from config file");
         }
+        this->num_rounds = static_cast<size_t>(this->values[0]);
+        this->max_proposal_size = static_cast<size_t>(this->values[1]);
+        this->num_distinct_elements = static_cast<size_t>(this->values[2]);
+        this->values.reserve(this->max_proposal_size);
+    }
+
+    LatticeAgreementConfig(const LatticeAgreementConfig &) = delete;
+    LatticeAgreementConfig &operator=(const LatticeAgreementConfig &) = delete;
 
-        // Trash rest of line
-        std::string trash;
-        std::getline(file, trash);
+    ~LatticeAgreementConfig()
+    {
+        ::munmap(const_cast<char *>(this->data), this->length);
     }
 
-    size_t get_num_rounds() { return num_rounds; }
-    size_t get_max_proposal_size() { return max_proposal_size; }
-    size_t get_num_distinct_elements() { return num_distinct_elements; }
-    Proposal get_next_proposal() {
-        // Get line
-        std::string line;
-        std::getline(file, line);
-
-        // Prepare proposal
-        Proposal proposal;
-        ProposalValue proposal_value;
-        std::istringstream iss(line);
-        ProposalValue value;
-        while (iss >> value) {
-            proposal.insert(value);
-        }
+    size_t get_num_rounds() const { return num_rounds; }
+    size_t get_max_proposal_size() const { return max_proposal_size; }
+    size_t get_num_distinct_elements() const { return num_distinct_elements; }
+    Proposal get_next_proposal(ProposalDomain &domain) {
+        Proposal proposal(domain);
+        if (this->cursor == this->data + this->length) { return proposal; }
+
+        this->values.clear();
+        this->cursor = this->parse_line(this->cursor, this->values);
+        proposal.insert(this->values.data(), this->values.size());
         return proposal;
     }
-};
\ No newline at end of file
+};
@@ -1,86 +1,102 @@
 #pragma once
 
+#include "hosts.hpp"
 #include "message.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+#include "send_buffer.hpp"
+#include "transport.hpp"
 
 #define MAX_RECEIVE_BUFFER_SIZE 65535
-#define MAX_SEND_BUFFER_SIZE 65536
+#define MAX_SEND_BUFFER_SIZE 1472 // Ethernet MTU minus IPv4 and UDP headers
 
 /**
- * @brief FairLossLink (UDP)
+ * @brief FairLossLink
  *
- * @details Send and receive messages over a network with fair loss (UDP)
+ * @details Send and receive messages over a network with fair loss, through a
+ * Transport (UDP unless a different factory is installed, see transport.hpp).
+ * A datagram carries a batch of transport messages (see SendBuffer), and a
+ * segmented send carries several datagrams to the same host at once.
  */
 class FairLossLink
 {
 private:
   Host host;
-  bool continue_receiving = true;
-  int sockfd;
+  std::atomic<bool> continue_receiving{true};
+  std::unique_ptr<Transport> transport;
+
+  void deliver(const char *buffer, size_t length, const std::function<void(std::vector<TransportMessage>)> &flDeliver) {
+    Metrics::add(Counter::PacketsReceived);
+    Metrics::add(Counter::BytesReceived, length);
+
+    // Deserialize batch of messages
+    auto tms = SendBuffer::deserialize(buffer, length);
+
+    TRACE_SPAN("flDeliver", tms.size());
+    flDeliver(std::move(tms));
+  }
 
 public:
-  FairLossLink(Host host, Hosts hosts) : host(host) {
-    this->sockfd = create_socket();
+  FairLossLink(Host host, const Hosts &hosts) : host(host), transport(Transport::create(host, hosts)) {}
+
+  void send(const Host &receiver, const char *payload, size_t payload_length)
+  {
+    // Send datagram
+    this->transport->send(receiver, payload, payload_length);
+    Metrics::add(Counter::PacketsSent);
+    Metrics::add(Counter::BytesSent, payload_length);
   }
 
-  void send(TransportMessage tm)
+  // Send datagrams of `segment_size` bytes (the last one may be shorter) in one call
+  void send_segments(const Host &receiver, const char *payload, size_t payload_length, size_t segment_size)
   {
-    // Serialize message
-    uint64_t payload_length;
-    auto payload = tm.serialize(payload_length);
-
-    // Send message
-    sockaddr_in address = tm.get_receiver().get_address().to_sockaddr();
-    // std::cout << "flSend: " << tm << std::endl;
-    sendto(this->sockfd, payload.get(), payload_length, 0,
-                reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    this->transport->send_segments(receiver, payload, payload_length, segment_size);
+    Metrics::add(Counter::PacketsSent, (payload_length + segment_size - 1) / segment_size);
+    Metrics::add(Counter::BytesSent, payload_length);
   }
 
+  // Datagrams of `segment_size` bytes a segmented send may carry, 1 without segmentation
+  size_t max_segments(size_t segment_size) const {
+    return std::max<size_t>(1, std::min<size_t>(this->transport->max_segments(), UDP_MAX_PAYLOAD / segment_size));
+  }
+
+  // Stop receiving, also wakes up a blocked receive
   void shutdown() {
     this->continue_receiving = false;
+    this->transport->shutdown();
+  }
+
+  // Whether the transport runs the link's work (see Transport), start_receiving() then returns right away
+  bool is_event_driven() const {
+    return this->transport->is_event_driven();
+  }
+
+  void schedule(uint64_t delay_ns, std::function<void()> task) {
+    this->transport->schedule(delay_ns, std::move(task));
   }
 
-  void start_receiving(std::function<void(TransportMessage)> flDeliver) {
+  void start_receiving(std::function<void(std::vector<TransportMessage>)> flDeliver) {
     // std::cout << "Starting receiving on " << host.get_address().to_string() << "\n";
 
+    if (this->is_event_driven()) {
+      this->transport->on_receive([this, flDeliver](const char *buffer, size_t length) {
+        if (this->continue_receiving) { this->deliver(buffer, length, flDeliver); }
+      });
+      return;
+    }
+
     char buffer[MAX_RECEIVE_BUFFER_SIZE];
-    sockaddr_in source;
-    socklen_t source_length = sizeof(source);
 
     while (this->continue_receiving)
     {
       // Receive message
-      auto num_bytes = recvfrom(this->sockfd, buffer, MAX_RECEIVE_BUFFER_SIZE, 0,
-                               reinterpret_cast<sockaddr *>(&source), &source_length);
-      
-      if (num_bytes < 0) {
+      auto num_bytes = this->transport->receive(buffer, MAX_RECEIVE_BUFFER_SIZE);
+
+      if (num_bytes < 0 || !this->continue_receiving) {
         break;
       }
 
-      // Deserialize message
-      TransportMessage tm(buffer);
-
-      // std::cout << "flDeliver: " << tm << std::endl;
-      flDeliver(tm);
-    }
-    close_socket();
-  }
-
-private:
-  int create_socket() {
-    // Create socket
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0) {
-      throw std::runtime_error("Failed to create socket at " + this->host.get_address().to_string());
-    }
-
-    // Bind socket
-    auto sock_addr = this->host.get_address().to_sockaddr();
-    if (bind(sockfd, reinterpret_cast<sockaddr *>(&sock_addr), sizeof(sock_addr)) == -1) {
-      throw std::runtime_error("Failed to bind socket at " + host.get_address().to_string());
+      this->deliver(buffer, static_cast<size_t>(num_bytes), flDeliver);
     }
-
-    return sockfd;
   }
-
-  void close_socket() { close(this->sockfd); }
 };
@@ -3,8 +3,12 @@
 
 #include "message_set.hpp"
 #include "receive_buffer.hpp"
+#include "stage.hpp"
 #include "uniform_reliable_broadcast.hpp"
 #include "hosts.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 
 /**
  * @brief FIFO-Order Uniform Reliable Broadcast (FRB)
@@ -22,31 +26,49 @@
  * - (FRB5: FIFO Order) If some process broadcasts message m before it
  *   broadcasts message n, then no correct process delivers n unless it has
  *   already delivered m.
+ *
+ * frbDeliver runs on a Stage of its own, so the application callback never
+ * holds up the protocol.
  */
 class FIFOUniformReliableBroadcast {
 private:
-    UniformReliableBroadcast urb;
-    ReceiveBuffer receive_buffer;
     std::function<void(BroadcastMessage)> frbDeliver;
+    ReceiveBuffer receive_buffer;
+    Stage<BroadcastMessage> delivery; // Runs frbDeliver
+    UniformReliableBroadcast urb; // Last, starts delivering before the constructor returns
 
     void urbDeliver(BroadcastMessage bm) {
         auto bms = this->receive_buffer.deliver(bm);
-        for (auto &bm : bms) {
-            std::cout << "frbDeliver: " << bm << std::endl;
-            this->frbDeliver(bm);
-        }
+        if (!bms.empty()) { this->delivery.push(std::move(bms)); }
     }
 
 public:
-    FIFOUniformReliableBroadcast(Host host, Hosts hosts, std::function<void(BroadcastMessage)> frbDeliver):
-        urb(host, hosts, [this](BroadcastMessage bm) { this->urbDeliver(std::move(bm)); }),
-        receive_buffer(hosts), frbDeliver(frbDeliver) {}
+    FIFOUniformReliableBroadcast(Host host, const Hosts &hosts, std::function<void(BroadcastMessage)> frbDeliver, BebMode beb_mode = BebMode::Direct):
+        frbDeliver(frbDeliver), receive_buffer(hosts),
+        delivery("frb-" + std::to_string(host.get_id()), Gauge::DeliveryStageDepth, [this](std::vector<BroadcastMessage> bms) {
+            for (auto &bm : bms) {
+                TRACE_SPAN("frbDeliver", bm.get_source_id());
+                LOG_TRACE("frbDeliver: " << bm);
+                Metrics::add(Counter::FrbDelivered);
+                if constexpr (LATENCY_TRACKING) { Metrics::record_since(Latency::FrbDelivery, bm.get_timestamp()); }
+                this->frbDeliver(std::move(bm));
+            }
+        }),
+        urb(host, hosts, [this](BroadcastMessage bm) { this->urbDeliver(std::move(bm)); }, beb_mode) {
+        this->delivery.start(!this->urb.is_event_driven());
+    }
+
+    ~FIFOUniformReliableBroadcast() {
+        this->shutdown();
+    }
 
     void broadcast(Message &m) {
         this->urb.broadcast(m);
     }
 
+    // Stops the protocol first, so nothing is pushed to a stopped stage
     void shutdown() {
         this->urb.shutdown();
+        this->delivery.stop();
     }
 };
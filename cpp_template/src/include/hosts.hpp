@@ -1,7 +1,6 @@
 #pragma once
 
 #include <vector>
-#include <unordered_map>
 
 #include "host.hpp"
 #include "address.hpp"
@@ -9,14 +8,33 @@
 /**
  * @brief Hosts
  *
- * @details Reads the hosts file and stores the hosts and their addresses, also
- * provides a method to get the address of a host given its ID.
+ * @details Reads the hosts file into an immutable table indexed directly by
+ * host ID (1, ..., 128), with each host's socket address precomputed. The
+ * table is built once in main() and every layer keeps a const reference to it,
+ * so it is neither copied nor locked. Iterating over a Hosts goes through the
+ * hosts in file order without copying them.
  */
 class Hosts
 {
 private:
-    std::vector<Host> hosts;
-    std::unordered_map<size_t, Address> host_to_address;
+    std::vector<Host> hosts; // In file order
+    std::vector<Host> by_id; // Indexed by ID, default Host (ID 0) where there is none
+    std::vector<sockaddr_in> sockaddrs; // Indexed by ID
+
+    void add(const Host &host)
+    {
+        size_t id = host.get_id();
+        if (id >= this->by_id.size()) {
+            this->by_id.resize(id + 1);
+            this->sockaddrs.resize(id + 1);
+        }
+        if (this->by_id[id].get_id() != 0) {
+            throw std::runtime_error("Duplicate host ID " + std::to_string(id));
+        }
+        this->hosts.push_back(host);
+        this->by_id[id] = host;
+        this->sockaddrs[id] = host.get_address().to_sockaddr();
+    }
 
 public:
     // Constructor from hosts file (`id ip port`)
@@ -38,31 +56,69 @@ public:
             size_t id;
             std::string ip;
             uint16_t port;
-            if (!(iss >> id >> ip >> port))
+            if (!(iss >> id >> ip >> port) || id == 0)
             {
                 throw std::runtime_error("Failed to parse hosts file");
             }
-            Address addr(ip, port);
-            this->hosts.push_back(Host(id, addr));
-            this->host_to_address[id] = addr;
+            this->add(Host(id, Address(ip, port)));
+        }
+    }
+
+    // Constructor from a list of hosts (e.g. an in-process cluster)
+    Hosts(const std::vector<Host> &hosts)
+    {
+        for (const auto &host : hosts) {
+            if (host.get_id() == 0) {
+                throw std::runtime_error("Host ID 0 is reserved");
+            }
+            this->add(host);
         }
     }
 
-    std::vector<Host> get_hosts()
+    // Shared by reference, never copied
+    Hosts(const Hosts &) = delete;
+    Hosts &operator=(const Hosts &) = delete;
+
+    const std::vector<Host> &get_hosts() const
     {
         return this->hosts;
     }
 
-    size_t get_host_count()
+    std::vector<Host>::const_iterator begin() const { return this->hosts.begin(); }
+    std::vector<Host>::const_iterator end() const { return this->hosts.end(); }
+
+    size_t get_host_count() const
     {
         return this->hosts.size();
     }
 
-    Address get_address(size_t host_id)
+    // Largest host ID plus one, the size of tables indexed by host ID
+    size_t get_id_bound() const
     {
-        if (this->host_to_address.find(host_id) == this->host_to_address.end()) {
+        return this->by_id.size();
+    }
+
+    bool contains(size_t host_id) const
+    {
+        return host_id < this->by_id.size() && this->by_id[host_id].get_id() != 0;
+    }
+
+    const Host &get_host(size_t host_id) const
+    {
+        if (!this->contains(host_id)) {
             throw std::runtime_error("Host ID not found");
         }
-        return this->host_to_address[host_id];
+        return this->by_id[host_id];
+    }
+
+    Address get_address(size_t host_id) const
+    {
+        return this->get_host(host_id).get_address();
+    }
+
+    // Socket address of a host, without bounds checks (hot path)
+    const sockaddr_in &get_sockaddr(size_t host_id) const
+    {
+        return this->sockaddrs[host_id];
     }
 };
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Messages carry a send timestamp (build with -DLATENCY_TRACKING=1, every process must agree)
+#ifndef LATENCY_TRACKING
+#define LATENCY_TRACKING 0
+#endif
+
+#define LATENCY_SUB_BITS 4 // 16 linear buckets per power of two, at most 1/16 relative error
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS ((64 - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+// Latencies measured per layer (names in Metrics::latency_names)
+enum class Latency : size_t {
+    PlAckRtt, // PL transmission to its ACK
+    UrbDelivery, // URB broadcast at the source to delivery here
+    FrbDelivery, // URB broadcast at the source to FIFO delivery here
+    LaDecision, // Proposal to decision of a round
+    Count
+};
+
+// Monotonic clock in nanoseconds, comparable across processes of one machine
+inline uint64_t monotonic_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+/**
+ * @brief Latency Histogram
+ *
+ * @details Log-linear buckets in the style of HDR histograms: values below 16
+ * get a bucket each, every larger power of two is split into 16 equal
+ * buckets. Recording is a relaxed fetch_add on one bucket, so any thread may
+ * record without locks, and a percentile is within 1/16 of the exact value.
+ */
+class LatencyHistogram {
+private:
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+    std::atomic<uint64_t> max{0};
+
+    static size_t bucket_of(uint64_t value) {
+        if (value < LATENCY_SUB_BUCKETS) { return static_cast<size_t>(value); }
+        auto exponent = static_cast<size_t>(63 - __builtin_clzll(value));
+        size_t sub = static_cast<size_t>(value >> (exponent - LATENCY_SUB_BITS)) & (LATENCY_SUB_BUCKETS - 1);
+        return (exponent - LATENCY_SUB_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+    }
+
+    // Largest value that falls into a bucket
+    static uint64_t upper_bound(size_t bucket) {
+        if (bucket < LATENCY_SUB_BUCKETS) { return bucket; }
+        size_t exponent = bucket / LATENCY_SUB_BUCKETS + LATENCY_SUB_BITS - 1;
+        uint64_t sub = bucket % LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKETS;
+        return ((sub + 1) << (exponent - LATENCY_SUB_BITS)) - 1;
+    }
+
+public:
+    LatencyHistogram() {
+        for (auto &bucket : this->buckets) { bucket.store(0, std::memory_order_relaxed); }
+    }
+
+    void record(uint64_t value) {
+        this->buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t seen = this->max.load(std::memory_order_relaxed);
+        while (value > seen && !this->max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    // Time since a monotonic_ns() timestamp (0 if the clock went backwards)
+    void record_since(uint64_t start_ns) {
+        uint64_t now = monotonic_ns();
+        this->record(now > start_ns ? now - start_ns : 0);
+    }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (const auto &bucket : this->buckets) { total += bucket.load(std::memory_order_relaxed); }
+        return total;
+    }
+
+    // Value below which a fraction q of the recorded values fall (bucket upper bound)
+    uint64_t percentile(double q) const {
+        uint64_t total = this->count();
+        if (total == 0) { return 0; }
+        auto rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+            seen += this->buckets[i].load(std::memory_order_relaxed);
+            if (seen >= rank) { return std::min(upper_bound(i), this->max.load(std::memory_order_relaxed)); }
+        }
+        return this->max.load(std::memory_order_relaxed);
+    }
+
+    // {"count":..., "p50_us":..., "p99_us":..., "p999_us":..., "max_us":...} from nanosecond values
+    std::string to_json() const {
+        auto us = [](uint64_t ns) { return std::to_string(ns / 1000) + "." + std::to_string(ns % 1000 / 100); };
+        return "{\"count\":" + std::to_string(this->count()) +
+               ",\"p50_us\":" + us(this->percentile(0.5)) +
+               ",\"p99_us\":" + us(this->percentile(0.99)) +
+               ",\"p999_us\":" + us(this->percentile(0.999)) +
+               ",\"max_us\":" + us(this->max.load(std::memory_order_relaxed)) + "}";
+    }
+};
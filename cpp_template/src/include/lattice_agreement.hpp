@@ -2,121 +2,267 @@
 
 #include <set>
 #include <map>
+#include <atomic>
+#include <chrono>
+#include <optional>
 #include <condition_variable>
 
 #include "best_effort_broadcast.hpp"
+#include "log.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include "receive_buffer.hpp"
+#include "round_table.hpp"
+#include "stage.hpp"
 #include "message.hpp"
 
-/** @brief Lattice Agreement (LA) using Best-Effort Broadcast (BEB) */
+#define LA_DEFAULT_WINDOW 256
+#define LA_DEFAULT_BATCH 64 // Records per ProposalBatchMessage
+#define LA_MAX_FRAME_SIZE (MAX_SEND_BUFFER_SIZE - 64) // Leaves room for the transport headers
+#define LA_WAIT_POLL_MS 100 // A blocked propose() rechecks the horizon, silent hosts send no notification
+
+/**
+ * @brief Lattice Agreement (LA) using Best-Effort Broadcast (BEB)
+ *
+ * @details Runs many single-shot lattice agreement instances (rounds) side by
+ * side. At most `window` rounds are in flight: propose() blocks until every
+ * round below `round - window` has been decided, so memory and packet bursts
+ * stay bounded no matter how many rounds the config has. It also blocks while
+ * the round is past the RoundTable horizon of a live host's watermark, so
+ * peers keep the acceptor values a slow host still needs.
+ *
+ * Outgoing propose/ack/nack records are queued per host and sent as one
+ * ProposalBatchMessage, either once the frame is full or on flush(). Every
+ * received frame is handled in a single pass and flushes the replies.
+ *
+ * Round state lives in a RoundTable (see round_table.hpp) whose stripe locks
+ * are only held while a message updates its round. Replies are queued after
+ * the lock is released, in per-host outboxes. Decisions are put in round
+ * order under `window_lock`, which also guards the proposer's window, and
+ * `decide` runs on a Stage of its own, without the lock.
+ */
 class LatticeAgreement {
 private:
-    std::map<size_t, bool> active;
-    std::map<size_t, size_t> ack_count;
-    std::map<size_t, size_t> nack_count;
-    std::map<size_t, size_t> active_proposal_number;
-    std::map<size_t, Proposal> active_proposal;
-    std::map<size_t, Proposal> accepted_proposal;
-    Hosts hosts;
-    BestEffortBroadcast beb;
+    struct Outbox {
+        std::mutex lock;
+        ProposalBatchMessage frame;
+    };
+
+    size_t local_id;
+    const Hosts &hosts;
+    ProposalDomain &domain;
     std::function<void(Proposal)> decide;
     LatticeReceiveBuffer receive_buffer;
     size_t threshold;
-    // Limit sending pace
-    std::mutex lock;
+    size_t window; // Maximum number of rounds in flight
+    RoundTable rounds;
+    std::atomic<Round> decided_below{0}; // All rounds below have been decided (written under window_lock)
+    std::mutex window_lock;
+    std::condition_variable window_open;
+    size_t max_batch; // Maximum number of records per frame
+    std::vector<Outbox> outboxes; // Queued records per host id
+    Stage<Proposal> decisions; // Runs decide, in round order
+    BestEffortBroadcast beb; // Last, starts delivering before the constructor returns
 
     void bebDeliver(TransportMessage tm) {
-        ProposalMessage pm(tm.get_payload());
-        std::cout << "laDeliver: " << pm << " from " << tm.get_sender() << std::endl;
+        ProposalBatchMessage batch(tm.get_payload(), this->domain);
+        Host sender = tm.get_sender();
+        if (this->rounds.update_decided_below(sender.get_id(), batch.get_decided_below())) {
+            // Taking the lock orders the notification after a waiting proposer's check
+            { std::lock_guard<std::mutex> guard(this->window_lock); }
+            this->window_open.notify_all();
+        }
+
+        for (const auto &pm : batch.get_proposals()) {
+            this->deliver(pm, sender);
+        }
+        this->flush();
+    }
+
+    void deliver(const ProposalMessage &pm, const Host &sender) {
+        LOG_TRACE("laDeliver: " << pm << " from " << sender);
 
         auto type = pm.get_type();
         auto round = pm.get_round();
-        auto proposal = pm.get_proposal();
-
-        this->lock.lock();
-        if (type == ProposalMessage::Type::Propose) {
-            if (LatticeAgreement::is_subset(this->accepted_proposal[round], proposal)) {
-                this->accepted_proposal[round] = proposal;
-                ProposalMessage ack = ProposalMessage::create_ack(pm);
-                this->beb.send(ack, tm.get_sender());
-            } else {
-                LatticeAgreement::set_union(this->accepted_proposal[round], proposal);
-                ProposalMessage nack = ProposalMessage::create_nack(pm, this->accepted_proposal[round]);
-                this->beb.send(nack, tm.get_sender());
+        const auto &proposal = pm.get_proposal();
+
+        std::optional<ProposalMessage> reply, refined;
+        std::optional<Proposal> decision;
+        bool known = this->rounds.with_round(round, [&](RoundState &state) {
+            if (type == ProposalMessage::Type::Propose) {
+                reply = this->accept(pm, state.accepted_proposal);
+            } else if (type == ProposalMessage::Type::Ack) {
+                Metrics::add(Counter::LaAcks);
+                if (state.active_proposal_number == pm.get_proposal_number()) {
+                    state.ack_count++;
+                }
+            } else if (type == ProposalMessage::Type::Nack) {
+                Metrics::add(Counter::LaNacks);
+                if (state.active_proposal_number == pm.get_proposal_number()) {
+                    state.nack_count++;
+                    state.active_proposal.set_union(proposal);
+                }
             }
-        } else if (type == ProposalMessage::Type::Ack) {
-            if (this->active_proposal_number[round] == pm.get_proposal_number()) {
-                this->ack_count[round]++;
+
+            // Decide once a majority acked, otherwise refine after any nack
+            if (state.active && state.ack_count >= this->threshold) {
+                state.active = false;
+                decision = state.active_proposal;
+                Metrics::observe_refinements(static_cast<size_t>(state.active_proposal_number) - 1);
+                Metrics::record_since(Latency::LaDecision, state.proposed_at);
+            } else if (state.active && state.nack_count > 0 && state.ack_count + state.nack_count >= this->threshold) {
+                refined = this->refine(state);
+                Metrics::add(Counter::LaRefinements);
             }
-        } else if (type == ProposalMessage::Type::Nack) {
-            if (this->active_proposal_number[round] == pm.get_proposal_number()) { 
-                this->nack_count[round]++;
-                LatticeAgreement::set_union(this->active_proposal[round], proposal);
+        });
+        if (!known) {
+            // Decided here already, answer a late proposer from the round's acceptor value
+            if (type == ProposalMessage::Type::Propose) {
+                this->rounds.with_decided(round, [&](Proposal &accepted) { reply = this->accept(pm, accepted); });
             }
+            if (reply) { this->enqueue(*reply, sender); }
+            return;
+        }
+
+        if (reply) {
+            this->enqueue(*reply, sender);
         }
-        this->lock.unlock();
 
-        if (this->active[round] && this->nack_count[round] > 0 && this->ack_count[round] + this->nack_count[round] >= this->threshold) {
-            this->propose(round, this->active_proposal[round]);
+        if (refined) {
+            this->broadcast(*refined);
         }
 
-        if (this->active[round] && this->ack_count[round] >= this->threshold) {
-            this->active[round] = false;
-            std::vector<Proposal> proposals = this->receive_buffer.deliver(pm);
-            for (const auto& proposal: proposals) {
-                this->decide(proposal);
+        if (decision) {
+            TRACE_INSTANT("decide", round);
+            Metrics::add(Counter::LaDecisions);
+            Metrics::shift(Gauge::LaRoundsInFlight, -1);
+            std::unique_lock<std::mutex> guard(this->window_lock);
+            std::vector<Proposal> proposals = this->receive_buffer.deliver(round, std::move(*decision));
+
+            // Slide the window
+            for (size_t i = 0; i < proposals.size(); i++) {
+                this->rounds.retire(this->decided_below);
+                this->decided_below++;
+            }
+            this->rounds.update_decided_below(this->local_id, this->decided_below);
+            if (!proposals.empty()) {
+                // Pushed under the lock, so concurrent deciders still emit in round order
+                this->decisions.push(std::move(proposals));
+                guard.unlock();
+                this->window_open.notify_all();
             }
         }
     }
 
+    // Acceptor step: ack a proposal that contains the accepted one, otherwise nack with the union
+    ProposalMessage accept(const ProposalMessage &pm, Proposal &accepted) {
+        const auto &proposal = pm.get_proposal();
+        if (accepted.is_subset(proposal)) {
+            accepted = proposal;
+            return ProposalMessage::create_ack(pm);
+        }
+        accepted.set_union(proposal);
+        return ProposalMessage::create_nack(pm, accepted);
+    }
+
+    // Start a new proposal for a round with the current active proposal (requires the round's lock)
+    ProposalMessage refine(RoundState &state) {
+        state.ack_count = 0;
+        state.nack_count = 0;
+        state.active_proposal_number++;
+        return ProposalMessage(state.round, state.active_proposal_number, state.active_proposal);
+    }
+
+    void broadcast(const ProposalMessage &pm) {
+        LOG_TRACE("laPropose: " << pm);
+        Metrics::add(Counter::LaProposals);
+        for (const auto &host : this->hosts) {
+            this->enqueue(pm, host);
+        }
+    }
+
+    // Queue a record for a host, sending its frame first if it is full
+    void enqueue(const ProposalMessage &pm, const Host &receiver) {
+        Outbox &outbox = this->outboxes[receiver.get_id()];
+        std::lock_guard<std::mutex> guard(outbox.lock);
+        bool full = outbox.frame.size() >= this->max_batch || outbox.frame.get_length() + pm.record_length() > LA_MAX_FRAME_SIZE;
+        if (!outbox.frame.empty() && full) {
+            this->send(outbox.frame, receiver);
+        }
+        outbox.frame.add(pm);
+    }
+
+    // Send a frame stamped with the decision watermark (requires the outbox lock)
+    void send(ProposalBatchMessage &frame, const Host &receiver) {
+        frame.set_decided_below(this->decided_below);
+        this->beb.send(frame, receiver);
+        frame.clear();
+    }
+
 public:
-    LatticeAgreement(Host local_host, Hosts hosts, std::function<void(Proposal)> decide) :
-        active(std::map<Round, bool>()),
-        ack_count(std::map<Round, size_t>()),
-        nack_count(std::map<Round, size_t>()),
-        active_proposal_number(std::map<Round, size_t>()),
-        active_proposal(std::map<size_t, Proposal>()),
-        accepted_proposal(std::map<size_t, Proposal>()),
+    LatticeAgreement(Host local_host, const Hosts &hosts, ProposalDomain &domain, std::function<void(Proposal)> decide,
+                     size_t window = LA_DEFAULT_WINDOW, size_t max_batch = LA_DEFAULT_BATCH, size_t stripes = LA_DEFAULT_STRIPES) :
+        local_id(local_host.get_id()),
         hosts(hosts),
-        beb(local_host, hosts, [this](TransportMessage tm) { this->bebDeliver(std::move(tm)); }),
+        domain(domain),
         decide(decide),
         receive_buffer(hosts),
-        threshold(static_cast<size_t>(hosts.get_host_count() / 2 + 1)) {}
-
-    void propose(Round round, Proposal proposal) {
-        this->lock.lock();
-        this->active[round] = true;
-        this->ack_count[round] = 0;
-        this->nack_count[round] = 0;
-        this->active_proposal_number[round]++;
-        this->active_proposal[round] = proposal;
-        ProposalMessage pm(round, this->active_proposal_number[round], this->active_proposal[round]);
-        this->lock.unlock();
-
-        std::cout << "laPropose: " << pm << std::endl;
-        this->beb.broadcast(pm);
+        threshold(static_cast<size_t>(hosts.get_host_count() / 2 + 1)),
+        window(std::max<size_t>(window, 1)),
+        rounds(this->window, hosts, stripes),
+        max_batch(std::max<size_t>(max_batch, 1)),
+        outboxes(hosts.get_id_bound()),
+        decisions("la-" + std::to_string(local_host.get_id()), Gauge::DeliveryStageDepth, [this](std::vector<Proposal> proposals) {
+            for (const auto &proposal : proposals) { this->decide(proposal); }
+        }),
+        beb(local_host, hosts, [this](TransportMessage tm) { this->bebDeliver(std::move(tm)); }) {
+        this->decisions.start(!this->beb.is_event_driven());
     }
 
-    void shutdown() {
-        this->beb.shutdown();
+    ~LatticeAgreement() {
+        this->shutdown();
     }
 
-private:
-    static void set_union(Proposal &dest, Proposal &source) {
-        for (auto value : source) {
-            dest.insert(value);
+    // Propose for a round, blocks while the round is outside the window or the rounds' horizon
+    void propose(Round round, Proposal proposal) {
+        TRACE_SPAN("propose", round);
+        std::unique_lock<std::mutex> guard(this->window_lock);
+        auto in_window = [&]() { return round < this->decided_below + this->window && this->rounds.in_horizon(round); };
+        if (!in_window()) {
+            // Send queued proposals before waiting on them to decide
+            guard.unlock();
+            this->flush();
+            guard.lock();
+            while (!this->window_open.wait_for(guard, std::chrono::milliseconds(LA_WAIT_POLL_MS), in_window)) {}
         }
-    }
+        guard.unlock();
 
-    static bool is_subset(Proposal &subset, Proposal &superset) {
-        if (superset.size() < subset.size()) { return false; }
+        std::optional<ProposalMessage> pm;
+        this->rounds.with_round(round, [&](RoundState &state) {
+            state.active = true;
+            state.proposed_at = monotonic_ns();
+            state.active_proposal = std::move(proposal);
+            pm = this->refine(state);
+        });
+        if (pm) {
+            Metrics::shift(Gauge::LaRoundsInFlight, 1);
+            this->broadcast(*pm);
+        }
+    }
 
-        for (auto element : subset) {
-            if (superset.count(element) == 0) {
-                return false;
-            }
+    // Send all queued records
+    void flush() {
+        for (const auto &host : this->hosts) {
+            Outbox &outbox = this->outboxes[host.get_id()];
+            std::lock_guard<std::mutex> guard(outbox.lock);
+            if (outbox.frame.empty()) { continue; }
+            this->send(outbox.frame, host);
         }
+    }
 
-        return true;
+    // Stops the protocol first, so nothing is pushed to a stopped stage
+    void shutdown() {
+        this->beb.shutdown();
+        this->decisions.stop();
     }
-};
\ No newline at end of file
+};
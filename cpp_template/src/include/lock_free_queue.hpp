@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+/**
+ * @brief Bounded lock-free queue
+ *
+ * @details Ring of cells with a sequence number each (Vyukov's bounded MPMC
+ * queue). Producers and consumers claim a position with one CAS and publish
+ * the cell through its sequence number, so neither side ever blocks: a full
+ * queue fails try_push(), an empty one fails try_pop(). The capacity is
+ * rounded up to a power of two.
+ */
+template <typename T>
+class LockFreeQueue {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    size_t mask;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) std::atomic<size_t> dequeue_pos{0};
+
+    static size_t round_up(size_t capacity) {
+        size_t result = 2;
+        while (result < capacity) { result <<= 1; }
+        return result;
+    }
+
+public:
+    explicit LockFreeQueue(size_t capacity) : mask(round_up(capacity) - 1), cells(new Cell[mask + 1]) {
+        for (size_t i = 0; i <= this->mask; i++) {
+            this->cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool try_push(T &&item) {
+        size_t pos = this->enqueue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = this->cells[pos & this->mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0) {
+                if (this->enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(item);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = this->enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool try_pop(T &item) {
+        size_t pos = this->dequeue_pos.load(std::memory_order_relaxed);
+        while (true) {
+            Cell &cell = this->cells[pos & this->mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0) {
+                if (this->dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    item = std::move(cell.data);
+                    cell.sequence.store(pos + this->mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = this->dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Number of pushes claimed so far
+    size_t pushed() const { return this->enqueue_pos.load(std::memory_order_acquire); }
+
+    // Number of pops claimed so far
+    size_t popped() const { return this->dequeue_pos.load(std::memory_order_acquire); }
+};
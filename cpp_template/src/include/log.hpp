@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "lock_free_queue.hpp"
+#include "thread_placement.hpp"
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_DEBUG 3
+#define LOG_LEVEL_TRACE 4
+
+// Release builds keep info and up, debug builds trace everything (override with -DLOG_LEVEL=...)
+#ifndef LOG_LEVEL
+#ifdef NDEBUG
+#define LOG_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_LEVEL LOG_LEVEL_TRACE
+#endif
+#endif
+
+#define LOG_RECORD_SIZE 240 // Longer lines are truncated
+#define LOG_RING_CAPACITY 4096 // Records waiting for the writer, more are dropped
+
+/**
+ * @brief Log a streamed expression, e.g. LOG_TRACE("bebSend: " << m << " to " << host)
+ *
+ * @details The expression is only evaluated when the level is compiled in,
+ * otherwise the call site compiles to nothing.
+ */
+#define LOG(level, expr) \
+    do { \
+        if constexpr (LOG_LEVEL_##level <= LOG_LEVEL) { \
+            std::ostringstream log_stream; \
+            log_stream << expr << '\n'; \
+            Logger::instance().log(log_stream.str()); \
+        } \
+    } while (0)
+
+#define LOG_ERROR(expr) LOG(ERROR, expr)
+#define LOG_INFO(expr) LOG(INFO, expr)
+#define LOG_DEBUG(expr) LOG(DEBUG, expr)
+#define LOG_TRACE(expr) LOG(TRACE, expr)
+
+/**
+ * @brief Logger
+ *
+ * @details Log lines go into a bounded lock-free ring and a background thread
+ * writes them to stdout in batches. Logging never blocks or flushes on the
+ * caller's thread: when the ring is full the line is dropped and counted.
+ * The logger is created on first use.
+ */
+class Logger {
+private:
+    struct Record {
+        size_t length{0};
+        char text[LOG_RECORD_SIZE];
+    };
+
+    static inline std::atomic<Logger *> created{nullptr};
+
+    LockFreeQueue<Record> ring;
+    std::atomic<size_t> dropped{0};
+    std::atomic<size_t> written{0};
+    std::atomic<bool> running{true};
+    std::thread writer;
+
+    Logger() : ring(LOG_RING_CAPACITY) {
+        this->writer = std::thread(&Logger::run, this);
+        created = this;
+    }
+
+    // Write everything in the ring to stdout, returns the number of records
+    size_t drain() {
+        std::string batch;
+        Record record;
+        size_t count = 0;
+        while (this->ring.try_pop(record)) {
+            batch.append(record.text, record.length);
+            count++;
+        }
+        size_t dropped = this->dropped.exchange(0);
+        if (dropped > 0) {
+            batch += "[log] dropped " + std::to_string(dropped) + " lines\n";
+        }
+
+        size_t offset = 0;
+        while (offset < batch.size()) {
+            ssize_t n = ::write(STDOUT_FILENO, batch.data() + offset, batch.size() - offset);
+            if (n <= 0) { break; }
+            offset += static_cast<size_t>(n);
+        }
+        this->written.fetch_add(count, std::memory_order_release);
+        return count;
+    }
+
+    void run() {
+        ThreadPlacement::place("log");
+        while (this->running) {
+            if (this->drain() == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        this->drain();
+    }
+
+public:
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    ~Logger() {
+        this->running = false;
+        this->writer.join();
+    }
+
+    static Logger &instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    void log(const std::string &line) {
+        Record record;
+        record.length = std::min(line.size(), sizeof(record.text));
+        std::memcpy(record.text, line.data(), record.length);
+        if (record.length == sizeof(record.text)) { record.text[record.length - 1] = '\n'; }
+        if (!this->ring.try_push(std::move(record))) {
+            this->dropped++;
+        }
+    }
+
+    // Wait until the lines logged so far are written (no-op if nothing was ever logged)
+    static void flush() {
+        Logger *logger = created;
+        if (logger == nullptr) { return; }
+        size_t target = logger->ring.pushed();
+        while (logger->written.load(std::memory_order_acquire) < target && logger->running) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
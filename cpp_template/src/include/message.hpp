@@ -1,14 +1,19 @@
 #pragma once
 
 #include <atomic>
+#include <memory>
 #include <thread>
 #include <variant>
 
 // Project files
 #include "host.hpp"
+#include "latency.hpp"
+#include "proposal.hpp"
 #include "serialize.hpp"
 #include "types.hpp"
 
+// Sequence numbers
+const size_t SEQ_NUM_INIT = 0;
 
 /** @brief Base Message Class
  * 
@@ -19,7 +24,7 @@
  */
 class Message {
 public:
-    enum class Type { Transport, String, Broadcast, Proposal };
+    enum class Type { Transport, String, Broadcast, Proposal, ProposalBatch, Dissemination };
 protected:
     Type message_type;
     Message(Type message_type) : message_type(message_type) {}
@@ -68,14 +73,27 @@ public:
 }; 
 
 
+/**
+ * @brief Lattice agreement propose/ack/nack message
+ *
+ * @details Record layout: [type (1B)][round (varint)][number (varint)][set].
+ * Acks carry no set, nacks only carry the values the proposer is missing. The
+ * set is written either as a sorted delta list [0][count][first][delta]... or as
+ * a bitmap [1][min][bytes][bit i = min + i], whichever is shorter. The encoded
+ * set is cached, so computing the length and serializing encode only once (and
+ * copies of a message share the encoding).
+ */
 class ProposalMessage : public Message {
 public:
-    enum class Type { Propose, Ack, Nack };
+    enum class Type : uint8_t { Propose, Ack, Nack };
 private:
+    enum SetEncoding : uint8_t { DeltaList = 0, Bitmap = 1 };
+
     Type proposal_type;
     Round round;
     ProposalNumber proposal_number;
     Proposal proposal;
+    mutable std::shared_ptr<const std::string> encoded_set;
 
 public:
     ProposalMessage(ProposalNumber round, ProposalNumber proposal_number, Proposal proposal) : 
@@ -86,44 +104,57 @@ public:
             this->proposal_type = proposal_type;
         }
 
-    ProposalMessage(std::shared_ptr<char[]> payload) : Message(Message::Type::Proposal) { 
+    // Note: Values are mapped to the indices of the receiving process
+    ProposalMessage(std::shared_ptr<char[]> payload, ProposalDomain &domain) : Message(Message::Type::Proposal) { 
         size_t offset = sizeof(Message::Type);
-        this->proposal_type = deserialize_field<ProposalMessage::Type>(payload.get(), offset);
-        this->round = deserialize_field<Round>(payload.get(), offset);
-        this->proposal_number = deserialize_field<ProposalNumber>(payload.get(), offset);
-        size_t proposal_size = deserialize_field<size_t>(payload.get(), offset);
-        this->proposal = Proposal();
-        for (size_t i = 0; i < proposal_size; i++) {
-            this->proposal.insert(deserialize_field<ProposalValue>(payload.get(), offset));
-        }
+        this->deserialize_record(payload.get(), offset, domain);
+    }
+
+    // Deserialize from a record inside a ProposalBatchMessage
+    ProposalMessage(const char *buffer, size_t &offset, ProposalDomain &domain) : Message(Message::Type::Proposal) {
+        this->deserialize_record(buffer, offset, domain);
     }
 
-    static ProposalMessage create_ack(ProposalMessage p) {
-        return ProposalMessage(ProposalMessage::Type::Ack, p.round, p.proposal_number, p.proposal);
+    // Acks carry no values: the proposer knows what it proposed
+    static ProposalMessage create_ack(const ProposalMessage &p) {
+        return ProposalMessage(ProposalMessage::Type::Ack, p.round, p.proposal_number, Proposal());
     }
-    static ProposalMessage create_nack(ProposalMessage p, Proposal proposal) {
-        return ProposalMessage(ProposalMessage::Type::Nack, p.round, p.proposal_number, proposal);
+    // Nacks carry the accepted values the proposal is missing
+    static ProposalMessage create_nack(const ProposalMessage &p, const Proposal &accepted) {
+        return ProposalMessage(ProposalMessage::Type::Nack, p.round, p.proposal_number, accepted.difference(p.proposal));
     }
 
     std::shared_ptr<char[]> serialize(size_t &length) {
-        length = sizeof(Message::Type) + sizeof(ProposalMessage::Type) + sizeof(round) + sizeof(proposal_number) + sizeof(proposal) + sizeof(size_t) + sizeof(ProposalValue) * proposal.size();
+        length = sizeof(Message::Type) + this->record_length();
 
         size_t offset = 0; auto payload = std::shared_ptr<char[]>(new char[length]);
         serialize_field(payload.get(), offset, message_type);
-        serialize_field(payload.get(), offset, proposal_type);
-        serialize_field(payload.get(), offset, round);
-        serialize_field(payload.get(), offset, proposal_number);
-        serialize_field(payload.get(), offset, proposal.size());
-        for (const auto& value : proposal) {
-            serialize_field(payload.get(), offset, value);
-        }
+        this->serialize_record(payload.get(), offset);
 
         return payload;
     }
 
+    // Record layout (without message type) used inside a ProposalBatchMessage
+    size_t record_length() const {
+        size_t length = sizeof(ProposalMessage::Type) + Varint::length(this->round) + Varint::length(this->proposal_number);
+        if (this->proposal_type != ProposalMessage::Type::Ack) { length += this->get_encoded_set().size(); }
+        return length;
+    }
+
+    void serialize_record(char *buffer, size_t &offset) const {
+        serialize_field(buffer, offset, proposal_type);
+        Varint::serialize(buffer, offset, this->round);
+        Varint::serialize(buffer, offset, this->proposal_number);
+        if (this->proposal_type != ProposalMessage::Type::Ack) {
+            const auto &set = this->get_encoded_set();
+            std::memcpy(buffer + offset, set.data(), set.size());
+            offset += set.size();
+        }
+    }
+
     Round get_round() const { return this->round; }
     ProposalNumber get_proposal_number() const { return this->proposal_number; }
-    Proposal get_proposal() const { return this->proposal; }
+    const Proposal &get_proposal() const { return this->proposal; }
     ProposalMessage::Type get_type() const { return this->proposal_type; }
 
     std::string to_string() const {
@@ -138,30 +169,174 @@ public:
                 result += "PROPOSE, ";
             }
             result += round_proposal_number + ", proposal={ ";
-            for (const auto& value : this->proposal) {
-                result += std::to_string(value) + " ";
-            }
+            this->proposal.for_each([&](ProposalValue value) { result += std::to_string(value) + " "; });
             result += "}";
         }
         result += ")";
         return result;
     }
+
+private:
+    const std::string &get_encoded_set() const {
+        if (!this->encoded_set) {
+            this->encoded_set = std::make_shared<const std::string>(encode_set(this->proposal.sorted_values()));
+        }
+        return *this->encoded_set;
+    }
+
+    static std::string encode_set(const std::vector<ProposalValue> &values) {
+        // Size both encodings, the bitmap spans [min, max]
+        size_t list_length = 1 + Varint::length(values.size());
+        size_t bitmap_bytes = 0;
+        if (!values.empty()) {
+            list_length += Varint::length(Varint::zigzag(values.front()));
+            for (size_t i = 1; i < values.size(); i++) {
+                list_length += Varint::length(static_cast<uint64_t>(static_cast<int64_t>(values[i]) - values[i - 1]));
+            }
+            bitmap_bytes = static_cast<size_t>(static_cast<int64_t>(values.back()) - values.front()) / 8 + 1;
+        }
+        size_t bitmap_length = 1 + Varint::length(Varint::zigzag(values.empty() ? 0 : values.front())) + Varint::length(bitmap_bytes) + bitmap_bytes;
+
+        std::string encoded;
+        size_t offset = 0;
+        if (list_length <= bitmap_length) {
+            encoded.resize(list_length);
+            encoded[offset++] = static_cast<char>(SetEncoding::DeltaList);
+            Varint::serialize(encoded.data(), offset, values.size());
+            for (size_t i = 0; i < values.size(); i++) {
+                Varint::serialize(encoded.data(), offset, i == 0 ? Varint::zigzag(values[i]) : static_cast<uint64_t>(static_cast<int64_t>(values[i]) - values[i - 1]));
+            }
+        } else {
+            encoded.resize(bitmap_length);
+            encoded[offset++] = static_cast<char>(SetEncoding::Bitmap);
+            Varint::serialize(encoded.data(), offset, Varint::zigzag(values.front()));
+            Varint::serialize(encoded.data(), offset, bitmap_bytes);
+            for (auto value : values) {
+                auto bit = static_cast<size_t>(static_cast<int64_t>(value) - values.front());
+                encoded[offset + bit / 8] = static_cast<char>(encoded[offset + bit / 8] | (1 << (bit % 8)));
+            }
+        }
+        return encoded;
+    }
+
+    void deserialize_record(const char *buffer, size_t &offset, ProposalDomain &domain) {
+        this->proposal_type = deserialize_field<ProposalMessage::Type>(buffer, offset);
+        this->round = Varint::deserialize(buffer, offset);
+        this->proposal_number = Varint::deserialize(buffer, offset);
+        this->proposal = Proposal(domain);
+        if (this->proposal_type == ProposalMessage::Type::Ack) { return; }
+
+        // Decode into scratch space and insert in bulk, one sorted insert per value is quadratic
+        static thread_local std::vector<ProposalValue> values;
+        values.clear();
+        auto encoding = static_cast<SetEncoding>(buffer[offset++]);
+        if (encoding == SetEncoding::DeltaList) {
+            size_t count = Varint::deserialize(buffer, offset);
+            values.reserve(count);
+            int64_t value = 0;
+            for (size_t i = 0; i < count; i++) {
+                uint64_t delta = Varint::deserialize(buffer, offset);
+                value = i == 0 ? Varint::unzigzag(delta) : value + static_cast<int64_t>(delta);
+                values.push_back(static_cast<ProposalValue>(value));
+            }
+        } else if (encoding == SetEncoding::Bitmap) {
+            int64_t min = Varint::unzigzag(Varint::deserialize(buffer, offset));
+            size_t bytes = Varint::deserialize(buffer, offset);
+            for (size_t byte = 0; byte < bytes; byte++) {
+                for (unsigned bits = static_cast<uint8_t>(buffer[offset + byte]); bits != 0; bits &= bits - 1) {
+                    values.push_back(static_cast<ProposalValue>(min + static_cast<int64_t>(byte * 8) + __builtin_ctz(bits)));
+                }
+            }
+            offset += bytes;
+        } else {
+            throw std::runtime_error("Unknown proposal set encoding");
+        }
+        this->proposal.insert(values.data(), values.size());
+    }
+};
+
+/**
+ * @brief Batch of proposal messages for the same host
+ *
+ * @details Packs the propose/ack/nack records of many rounds bound for one
+ * host into a single message: [message type][decided below][count][record]...
+ * The header carries the sender's decision watermark (all rounds below it are
+ * decided), which lets receivers reclaim per-round state.
+ */
+class ProposalBatchMessage : public Message {
+private:
+    std::vector<ProposalMessage> proposals;
+    Round decided_below{0};
+    size_t length; // Serialized length
+
+    static constexpr size_t header_length = sizeof(Message::Type) + sizeof(Round) + sizeof(size_t);
+
+public:
+    ProposalBatchMessage() : Message(Message::Type::ProposalBatch), length(header_length) {}
+
+    ProposalBatchMessage(std::shared_ptr<char[]> payload, ProposalDomain &domain) : ProposalBatchMessage() {
+        size_t offset = sizeof(Message::Type);
+        this->decided_below = deserialize_field<Round>(payload.get(), offset);
+        size_t count = deserialize_field<size_t>(payload.get(), offset);
+        this->proposals.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            this->add(ProposalMessage(payload.get(), offset, domain));
+        }
+    }
+
+    void add(ProposalMessage pm) {
+        this->length += pm.record_length();
+        this->proposals.push_back(std::move(pm));
+    }
+
+    void clear() {
+        this->proposals.clear();
+        this->length = header_length;
+    }
+
+    std::shared_ptr<char[]> serialize(size_t &length) {
+        length = this->length;
+
+        size_t offset = 0; auto payload = std::shared_ptr<char[]>(new char[length]);
+        serialize_field(payload.get(), offset, message_type);
+        serialize_field(payload.get(), offset, decided_below);
+        serialize_field(payload.get(), offset, proposals.size());
+        for (const auto &pm : this->proposals) {
+            pm.serialize_record(payload.get(), offset);
+        }
+
+        return payload;
+    }
+
+    const std::vector<ProposalMessage> &get_proposals() const { return this->proposals; }
+    size_t size() const { return this->proposals.size(); }
+    bool empty() const { return this->proposals.empty(); }
+    size_t get_length() const { return this->length; }
+    Round get_decided_below() const { return this->decided_below; }
+    void set_decided_below(Round round) { this->decided_below = round; }
+
+    std::string to_string() const {
+        return "ProposalBatchMessage(count=" + std::to_string(this->proposals.size()) + ", length=" + std::to_string(this->length) + ")";
+    }
 };
 
 class BroadcastMessage : public Message {
 private:
-    static std::atomic_uint32_t next_id;
-    size_t seq_number;
+    size_t seq_number; // Per source, numbered by the source's URB
     size_t source_id;
     size_t length;
     std::shared_ptr<char[]> payload;
+    uint64_t timestamp{0}; // monotonic_ns() at the source's broadcast, on the wire only with LATENCY_TRACKING
+
+    static constexpr size_t timestamp_length = LATENCY_TRACKING ? sizeof(uint64_t) : 0;
 
 public:
     BroadcastMessage(size_t seq_number, size_t source_id, size_t length, std::shared_ptr<char[]> payload) : 
         Message(Message::Type::Broadcast), seq_number(seq_number), source_id(source_id), length(length), payload(std::move(payload)) {}
 
-    BroadcastMessage(Message &m, size_t source_id) : Message(Message::Type::Broadcast), seq_number(next_id++), source_id(source_id) {
+    BroadcastMessage(Message &m, size_t seq_number, size_t source_id) : Message(Message::Type::Broadcast), seq_number(seq_number), source_id(source_id) {
         this->payload = m.serialize(this->length);
+        if constexpr (LATENCY_TRACKING) { this->timestamp = monotonic_ns(); }
     }
 
     BroadcastMessage(std::shared_ptr<char[]> payload) : Message(Message::Type::Broadcast) { 
@@ -169,18 +344,20 @@ public:
         this->seq_number = deserialize_field<size_t>(payload.get(), offset);
         this->source_id = deserialize_field<size_t>(payload.get(), offset);
         this->length = deserialize_field<size_t>(payload.get(), offset);
+        if constexpr (LATENCY_TRACKING) { this->timestamp = deserialize_field<uint64_t>(payload.get(), offset); }
         this->payload = std::shared_ptr<char[]>(new char[this->length]);
         if (length > 0) { std::memcpy(this->payload.get(), payload.get() + offset, length); }
     }
 
     std::shared_ptr<char[]> serialize(size_t &length) {
-        length = sizeof(this->message_type) + sizeof(this->seq_number) + sizeof(this->source_id) + sizeof(this->length) + this->length;
+        length = sizeof(this->message_type) + sizeof(this->seq_number) + sizeof(this->source_id) + sizeof(this->length) + timestamp_length + this->length;
 
         size_t offset = 0; std::shared_ptr<char[]> payload(new char[length]);
         serialize_field(payload.get(), offset, this->message_type);
         serialize_field(payload.get(), offset, this->seq_number);
         serialize_field(payload.get(), offset, this->source_id);
         serialize_field(payload.get(), offset, this->length);
+        if constexpr (LATENCY_TRACKING) { serialize_field(payload.get(), offset, this->timestamp); }
         if (this->length > 0) { std::memcpy(payload.get() + offset, this->payload.get(), this->length); } 
 
         return payload;
@@ -190,6 +367,7 @@ public:
     size_t get_source_id() const { return this->source_id; }
     size_t get_length() const { return this->length; }
     std::shared_ptr<char[]> get_payload() const { return this->payload; }
+    uint64_t get_timestamp() const { return this->timestamp; }
 
     std::string to_string() const {
         std::string result = "BroadcastMessage(";
@@ -202,18 +380,108 @@ public:
 };
 
 
+/**
+ * @brief Tree dissemination record of BestEffortBroadcast
+ *
+ * @details Data carries one broadcast (origin, BEB sequence number, payload).
+ * Digest carries, per host ID, the first sequence number the sender has not
+ * delivered from that origin, for anti-entropy.
+ */
+class DisseminationMessage : public Message {
+public:
+    enum class Kind : uint8_t { Data, Digest };
+
+private:
+    Kind kind;
+    size_t origin_id{0};
+    size_t seq_number{0};
+    size_t length{0};
+    std::shared_ptr<char[]> payload;
+    std::vector<uint32_t> prefixes; // Digest only, indexed by host ID
+    std::vector<uint32_t> stalled; // Digest only, IDs of the originators whose prefix is stuck
+
+public:
+    DisseminationMessage(size_t origin_id, size_t seq_number, std::shared_ptr<char[]> payload, size_t length) :
+        Message(Message::Type::Dissemination), kind(Kind::Data), origin_id(origin_id), seq_number(seq_number), length(length), payload(std::move(payload)) {}
+
+    DisseminationMessage(std::vector<uint32_t> prefixes, std::vector<uint32_t> stalled) :
+        Message(Message::Type::Dissemination), kind(Kind::Digest), prefixes(std::move(prefixes)), stalled(std::move(stalled)) {}
+
+    DisseminationMessage(const std::shared_ptr<char[]> &buffer) : Message(Message::Type::Dissemination) {
+        size_t offset = sizeof(message_type);
+        this->kind = deserialize_field<Kind>(buffer.get(), offset);
+        if (this->kind == Kind::Data) {
+            this->origin_id = deserialize_field<size_t>(buffer.get(), offset);
+            this->seq_number = deserialize_field<size_t>(buffer.get(), offset);
+            this->length = deserialize_field<size_t>(buffer.get(), offset);
+            this->payload = std::shared_ptr<char[]>(new char[this->length]);
+            if (this->length > 0) { std::memcpy(this->payload.get(), buffer.get() + offset, this->length); }
+        } else {
+            size_t count = deserialize_field<size_t>(buffer.get(), offset);
+            this->prefixes.resize(count);
+            if (count > 0) { std::memcpy(this->prefixes.data(), buffer.get() + offset, count * sizeof(uint32_t)); }
+            offset += count * sizeof(uint32_t);
+            count = deserialize_field<size_t>(buffer.get(), offset);
+            this->stalled.resize(count);
+            if (count > 0) { std::memcpy(this->stalled.data(), buffer.get() + offset, count * sizeof(uint32_t)); }
+        }
+    }
+
+    std::shared_ptr<char[]> serialize(size_t &length) {
+        length = sizeof(this->message_type) + sizeof(this->kind) + (this->kind == Kind::Data
+            ? sizeof(this->origin_id) + sizeof(this->seq_number) + sizeof(this->length) + this->length
+            : 2 * sizeof(size_t) + (this->prefixes.size() + this->stalled.size()) * sizeof(uint32_t));
+
+        size_t offset = 0; std::shared_ptr<char[]> buffer(new char[length]);
+        serialize_field(buffer.get(), offset, this->message_type);
+        serialize_field(buffer.get(), offset, this->kind);
+        if (this->kind == Kind::Data) {
+            serialize_field(buffer.get(), offset, this->origin_id);
+            serialize_field(buffer.get(), offset, this->seq_number);
+            serialize_field(buffer.get(), offset, this->length);
+            if (this->length > 0) { std::memcpy(buffer.get() + offset, this->payload.get(), this->length); }
+        } else {
+            serialize_field(buffer.get(), offset, this->prefixes.size());
+            if (!this->prefixes.empty()) { std::memcpy(buffer.get() + offset, this->prefixes.data(), this->prefixes.size() * sizeof(uint32_t)); }
+            offset += this->prefixes.size() * sizeof(uint32_t);
+            serialize_field(buffer.get(), offset, this->stalled.size());
+            if (!this->stalled.empty()) { std::memcpy(buffer.get() + offset, this->stalled.data(), this->stalled.size() * sizeof(uint32_t)); }
+        }
+
+        return buffer;
+    }
+
+    Kind get_kind() const { return this->kind; }
+    size_t get_origin_id() const { return this->origin_id; }
+    size_t get_seq_number() const { return this->seq_number; }
+    size_t get_length() const { return this->length; }
+    std::shared_ptr<char[]> get_payload() const { return this->payload; }
+    const std::vector<uint32_t> &get_prefixes() const { return this->prefixes; }
+    const std::vector<uint32_t> &get_stalled() const { return this->stalled; }
+
+    std::string to_string() const {
+        if (this->kind == Kind::Digest) {
+            return "DisseminationMessage(digest, hosts=" + std::to_string(this->prefixes.size()) + ")";
+        }
+        return "DisseminationMessage(origin_id=" + std::to_string(this->origin_id) + ", seq_number=" + std::to_string(this->seq_number) + ")";
+    }
+};
+
 class TransportMessage: public Message {
 public:
     enum class Type { Data, Ack };
 
 private:
-    static std::atomic_uint32_t next_id;
+    static inline std::atomic_uint32_t next_id{SEQ_NUM_INIT};
     Type transport_type;
     Host sender;
     Host receiver;
     size_t seq_number;
     std::shared_ptr<char[]> payload;
     size_t length;
+    uint64_t timestamp{0}; // monotonic_ns() at the last transmission, echoed by the ACK (on the wire only with LATENCY_TRACKING)
+
+    static constexpr size_t timestamp_length = LATENCY_TRACKING ? sizeof(uint64_t) : 0;
 
 public:
     TransportMessage() : Message(Message::Type::Transport) {}
@@ -232,12 +500,13 @@ public:
         this->receiver = deserialize_field<Host>(buffer, offset);
         this->seq_number = deserialize_field<size_t>(buffer, offset);
         this->length = deserialize_field<size_t>(buffer, offset);
+        if constexpr (LATENCY_TRACKING) { this->timestamp = deserialize_field<uint64_t>(buffer, offset); }
         this->payload = std::shared_ptr<char[]>(new char[this->length]);
         if (this->length > 0) { std::memcpy(this->payload.get(), buffer + offset, this->length); }
      }
 
     std::shared_ptr<char[]> serialize(size_t &length) {
-        length = sizeof(this->message_type) + sizeof(this->transport_type) + sizeof(this->sender) + sizeof(this->receiver) + sizeof(this->seq_number) + sizeof(this->length) + this->length; 
+        length = sizeof(this->message_type) + sizeof(this->transport_type) + sizeof(this->sender) + sizeof(this->receiver) + sizeof(this->seq_number) + sizeof(this->length) + timestamp_length + this->length;
         size_t offset = 0; auto payload = std::shared_ptr<char[]>(new char[length]);
 
         serialize_field<Message::Type>(payload.get(), offset, this->message_type);
@@ -246,6 +515,7 @@ public:
         serialize_field<Host>(payload.get(), offset, this->receiver);
         serialize_field<size_t>(payload.get(), offset, this->seq_number);
         serialize_field<size_t>(payload.get(), offset, this->length);
+        if constexpr (LATENCY_TRACKING) { serialize_field<uint64_t>(payload.get(), offset, this->timestamp); }
         if (this->length > 0) { std::memcpy(payload.get() + offset, this->payload.get(), this->length); }
 
         return payload;
@@ -253,7 +523,14 @@ public:
 
     // Create ACK
     static TransportMessage create_ack(const TransportMessage tm) {
-        return TransportMessage(TransportMessage::Type::Ack, tm.receiver, tm.sender, tm.seq_number, nullptr, 0);
+        TransportMessage ack(TransportMessage::Type::Ack, tm.receiver, tm.sender, tm.seq_number, nullptr, 0);
+        ack.timestamp = tm.timestamp;
+        return ack;
+    }
+
+    // Record the transmission time (only sent with LATENCY_TRACKING)
+    void stamp() {
+        if constexpr (LATENCY_TRACKING) { this->timestamp = monotonic_ns(); }
     }
 
     // Getters
@@ -262,6 +539,7 @@ public:
     Host get_receiver() const { return this->receiver; }
     size_t get_length() const { return this->length; }
     bool is_ack() const { return (this->transport_type == TransportMessage::Type::Ack); }
+    uint64_t get_timestamp() const { return this->timestamp; }
     std::shared_ptr<char[]> get_payload() const {
         auto copy = std::shared_ptr<char[]>(new char[length]);
         std::memcpy(copy.get(), payload.get(), length);
@@ -279,8 +557,3 @@ public:
         return result;
     }
 };
-
-// Sequence numbers
-const size_t SEQ_NUM_INIT = 0;
-std::atomic_uint32_t TransportMessage::next_id{SEQ_NUM_INIT};
-std::atomic_uint32_t BroadcastMessage::next_id{SEQ_NUM_INIT};
\ No newline at end of file
@@ -17,9 +17,9 @@ private:
     std::mutex lock;
 
 public:
-    MessageSet(Hosts hosts) {
+    MessageSet(const Hosts &hosts) {
         this->lock.lock();
-        for (const auto& host : hosts.get_hosts()) {
+        for (const auto& host : hosts) {
             messages[host.get_id()] = std::set<size_t>();
         }
         this->lock.unlock();
@@ -51,9 +51,9 @@ private:
     std::mutex lock;
 
 public:
-    MessagePairSet(Hosts hosts) {
+    MessagePairSet(const Hosts &hosts) {
         this->lock.lock();
-        for (const auto& host : hosts.get_hosts()) {
+        for (const auto& host : hosts) {
             messages[{host.get_id(), host.get_id()}] = std::set<size_t>();
         }
         this->lock.unlock();
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "latency.hpp"
+#include "thread_placement.hpp"
+
+// Event counters, one per layer event (names in Metrics::counter_names)
+enum class Counter : size_t {
+    PacketsSent,
+    PacketsReceived,
+    BytesSent,
+    BytesReceived,
+    PlMessages, // Messages handed to perfect links
+    PlTransmissions, // Messages put in a datagram, first sends and retransmits
+    PlDuplicates, // Received messages delivered before
+    PlAcksSent,
+    PlAcksReceived,
+    BebBroadcasts,
+    BebForwards, // Tree mode: messages relayed to children
+    BebDigests, // Tree mode: anti-entropy digests sent
+    BebRepairs, // Tree mode: messages resent in reply to a digest
+    UrbBroadcasts,
+    UrbRelays,
+    UrbDelivered,
+    FrbDelivered,
+    LaProposals, // Proposals broadcast, first ones and refinements
+    LaAcks,
+    LaNacks,
+    LaRefinements,
+    LaDecisions,
+    LaExpired, // Late proposals left unanswered, their round's acceptor value was dropped
+    StageStalls, // Pushes that waited for room in a full Stage queue
+    PlTimeouts, // Retransmissions after the retransmission timeout
+    PacerThrottled, // Sending passes in which the pacer held back a receiver's messages
+    SocketDrops, // Datagrams the kernel dropped on a full socket receive buffer (SO_RXQ_OVFL)
+    Count
+};
+
+// Current values, set rather than added up
+enum class Gauge : size_t {
+    FrbBuffered, // Messages waiting in the FIFO receive buffer
+    LaRoundsInFlight, // Proposed rounds not decided yet
+    PlStageDepth, // Delivered by perfect links, waiting for the protocol stage
+    DeliveryStageDepth, // FRB deliveries and decisions waiting for the application callback
+    PacerRate, // Pacing rates summed over peers, messages per second
+    Count
+};
+
+#define METRICS_COUNTERS static_cast<size_t>(Counter::Count)
+#define METRICS_GAUGES static_cast<size_t>(Gauge::Count)
+#define METRICS_REFINEMENT_BUCKETS 8 // Refinements per decided round: 0, 1, ..., 6, 7+
+#define METRICS_DEFAULT_INTERVAL_MS 1000
+
+/**
+ * @brief Metrics
+ *
+ * @details Every thread counts into its own cache-line-aligned block, so
+ * counting is a relaxed load and store with no sharing between threads.
+ * Blocks are registered on first use and outlive their thread. to_json()
+ * sums all blocks on demand. start() appends a snapshot as one JSON line to a
+ * file every interval; dump() does the same right away (main() calls it on
+ * SIGUSR1). A line looks like
+ *
+ *   {"time_ms":..., "counters":{"packets_sent":..., ...},
+ *    "gauges":{"frb_buffered":..., ...}, "la_refinements_per_round":[...],
+ *    "latency":{"pl_ack_rtt":{"count":..., "p50_us":..., ...}, ...}}
+ *
+ * on a single line, with pl_retransmits = pl_transmissions - pl_messages
+ * added to the counters. Only la_decision latency is measured unless
+ * messages carry timestamps (LATENCY_TRACKING).
+ */
+class Metrics {
+private:
+    struct alignas(64) Block {
+        std::atomic<uint64_t> values[METRICS_COUNTERS + METRICS_REFINEMENT_BUCKETS];
+
+        Block() {
+            for (auto &value : this->values) { value.store(0, std::memory_order_relaxed); }
+        }
+    };
+
+    static constexpr const char *counter_names[METRICS_COUNTERS] = {
+        "packets_sent", "packets_received", "bytes_sent", "bytes_received",
+        "pl_messages", "pl_transmissions", "pl_duplicates", "pl_acks_sent", "pl_acks_received",
+        "beb_broadcasts", "beb_forwards", "beb_digests", "beb_repairs", "urb_broadcasts", "urb_relays", "urb_delivered", "frb_delivered",
+        "la_proposals", "la_acks", "la_nacks", "la_refinements", "la_decisions", "la_expired", "stage_stalls",
+        "pl_timeouts", "pacer_throttled", "socket_drops",
+    };
+    static constexpr const char *gauge_names[METRICS_GAUGES] = {
+        "frb_buffered", "la_rounds_in_flight", "pl_stage_depth", "delivery_stage_depth", "pacer_rate",
+    };
+    static constexpr const char *latency_names[static_cast<size_t>(Latency::Count)] = {
+        "pl_ack_rtt", "urb_delivery", "frb_delivery", "la_decision",
+    };
+
+    std::mutex blocks_lock;
+    std::vector<std::unique_ptr<Block>> blocks;
+    std::atomic<int64_t> gauges[METRICS_GAUGES]{};
+    LatencyHistogram latencies[static_cast<size_t>(Latency::Count)];
+
+    std::mutex dump_lock; // Guards fd and the dump thread
+    int fd{-1};
+    std::thread dumper;
+    bool dumping{false};
+    std::condition_variable dumping_changed;
+
+    Metrics() = default;
+
+    Block &local() {
+        static thread_local Block *block = nullptr;
+        if (block == nullptr) {
+            std::lock_guard<std::mutex> guard(this->blocks_lock);
+            this->blocks.emplace_back(new Block());
+            block = this->blocks.back().get();
+        }
+        return *block;
+    }
+
+    void bump(size_t slot, uint64_t n) {
+        auto &value = this->local().values[slot];
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    // One JSON line, appended to the file (or to stderr without one)
+    void write_line() {
+        std::string line = this->to_json() + "\n";
+        int target = this->fd >= 0 ? this->fd : STDERR_FILENO;
+        size_t offset = 0;
+        while (offset < line.size()) {
+            ssize_t n = ::write(target, line.data() + offset, line.size() - offset);
+            if (n <= 0) { break; }
+            offset += static_cast<size_t>(n);
+        }
+    }
+
+public:
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    ~Metrics() {
+        this->stop();
+    }
+
+    static Metrics &instance() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    static void add(Counter counter, uint64_t n = 1) {
+        instance().bump(static_cast<size_t>(counter), n);
+    }
+
+    static void set(Gauge gauge, int64_t value) {
+        instance().gauges[static_cast<size_t>(gauge)].store(value, std::memory_order_relaxed);
+    }
+
+    static void shift(Gauge gauge, int64_t delta) {
+        instance().gauges[static_cast<size_t>(gauge)].fetch_add(delta, std::memory_order_relaxed);
+    }
+
+    // Count a decided round that took `refinements` refinements
+    static void observe_refinements(size_t refinements) {
+        size_t bucket = std::min<size_t>(refinements, METRICS_REFINEMENT_BUCKETS - 1);
+        instance().bump(METRICS_COUNTERS + bucket, 1);
+    }
+
+    // Record the time since a monotonic_ns() timestamp
+    static void record_since(Latency latency, uint64_t start_ns) {
+        instance().latencies[static_cast<size_t>(latency)].record_since(start_ns);
+    }
+
+    const LatencyHistogram &histogram(Latency latency) const {
+        return this->latencies[static_cast<size_t>(latency)];
+    }
+
+    // Sum of a counter over all threads
+    uint64_t total(Counter counter) {
+        return this->sum(static_cast<size_t>(counter));
+    }
+
+    uint64_t sum(size_t slot) {
+        std::lock_guard<std::mutex> guard(this->blocks_lock);
+        uint64_t total = 0;
+        for (const auto &block : this->blocks) {
+            total += block->values[slot].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+    std::string to_json() {
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        std::string json = "{\"time_ms\":" + std::to_string(now) + ",\"counters\":{";
+        for (size_t i = 0; i < METRICS_COUNTERS; i++) {
+            json += "\"" + std::string(counter_names[i]) + "\":" + std::to_string(this->sum(i)) + ",";
+        }
+        uint64_t messages = this->total(Counter::PlMessages), transmissions = this->total(Counter::PlTransmissions);
+        json += "\"pl_retransmits\":" + std::to_string(transmissions > messages ? transmissions - messages : 0);
+        json += "},\"gauges\":{";
+        for (size_t i = 0; i < METRICS_GAUGES; i++) {
+            json += (i > 0 ? ",\"" : "\"") + std::string(gauge_names[i]) + "\":" +
+                    std::to_string(this->gauges[i].load(std::memory_order_relaxed));
+        }
+        json += "},\"la_refinements_per_round\":[";
+        for (size_t i = 0; i < METRICS_REFINEMENT_BUCKETS; i++) {
+            json += (i > 0 ? "," : "") + std::to_string(this->sum(METRICS_COUNTERS + i));
+        }
+        json += "],\"latency\":{";
+        for (size_t i = 0; i < static_cast<size_t>(Latency::Count); i++) {
+            json += (i > 0 ? ",\"" : "\"") + std::string(latency_names[i]) + "\":" + this->latencies[i].to_json();
+        }
+        return json + "}}";
+    }
+
+    // Append a snapshot to the metrics file every interval until stop()
+    void start(const std::string &file_name, size_t interval_ms) {
+        std::lock_guard<std::mutex> guard(this->dump_lock);
+        if (this->fd >= 0) { return; }
+        this->fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (this->fd < 0) {
+            throw std::runtime_error("Failed to open metrics file: " + file_name);
+        }
+        if (interval_ms == 0) { return; }
+
+        this->dumping = true;
+        this->dumper = std::thread([this, interval_ms]() {
+            ThreadPlacement::place("metrics");
+            std::unique_lock<std::mutex> guard(this->dump_lock);
+            while (!this->dumping_changed.wait_for(guard, std::chrono::milliseconds(interval_ms), [this]() { return !this->dumping; })) {
+                this->write_line();
+            }
+        });
+    }
+
+    // Append a snapshot now
+    void dump() {
+        std::lock_guard<std::mutex> guard(this->dump_lock);
+        this->write_line();
+    }
+
+    // Stop the periodic dump, write a last snapshot and close the file
+    void stop() {
+        std::unique_lock<std::mutex> guard(this->dump_lock);
+        if (this->fd < 0) { return; }
+        this->dumping = false;
+        this->dumping_changed.notify_all();
+        guard.unlock();
+        if (this->dumper.joinable()) { this->dumper.join(); }
+        guard.lock();
+        this->write_line();
+        ::close(this->fd);
+        this->fd = -1;
+    }
+};
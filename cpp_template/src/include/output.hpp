@@ -1,42 +1,268 @@
 #pragma once
 
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "lock_free_queue.hpp"
+#include "proposal.hpp"
+#include "thread_placement.hpp"
+
+#define OUTPUT_QUEUE_CAPACITY (1 << 14) // Events in flight to the writer
+#define OUTPUT_CHUNK_SIZE (1 << 20) // Bytes per formatting buffer
+#define OUTPUT_MAX_CHUNKS 16 // Chunks gathered into one writev
+#define OUTPUT_IDLE_SLEEP_US 100
+
 /**
  * @brief Output
  *
- * @details Write to a file and flush the buffer when the object is destroyed.
+ * @details Delivery threads hand events ("b seq", "d sender seq" or a decided
+ * set) to the output file through a lock-free queue. Pushing an event is one
+ * CAS and a move, and no formatting happens on the caller's thread. A
+ * background writer drains the queue and formats integers straight into large
+ * page-aligned chunks. All chunks filled in one drain go to the file in a
+ * single writev (group commit). flush() waits until every event pushed before
+ * the call is on disk. The destructor writes the rest and closes the file.
  */
 class OutputFile
 {
 private:
-    std::ofstream file;
+    struct Event {
+        enum class Kind : uint8_t { Broadcast, Deliver, Decide };
+        Kind kind{Kind::Broadcast};
+        uint64_t sender{0};
+        uint64_t seq{0};
+        Proposal proposal;
+    };
+
+    struct Chunk {
+        char *data;
+        size_t capacity;
+        size_t length;
+    };
+
+    int fd;
+    LockFreeQueue<Event> queue;
+    std::vector<Chunk> chunks;
+    size_t active{0}; // Chunk currently formatted into
+    std::atomic<size_t> committed{0}; // Events written to the file
+    std::atomic<bool> running{true};
+    std::thread writer;
+
+    static Chunk allocate(size_t size) {
+        size_t capacity = (size + 4095) / 4096 * 4096;
+        auto data = static_cast<char *>(std::aligned_alloc(4096, capacity));
+        if (data == nullptr) { throw std::runtime_error("Failed to allocate output buffer"); }
+        return Chunk{data, capacity, 0};
+    }
+
+    // Digits of value, two at a time from a lookup table
+    static char *format_unsigned(char *out, uint64_t value) {
+        static const char pairs[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+        char digits[20];
+        char *end = digits + sizeof(digits), *p = end;
+        while (value >= 100) {
+            p -= 2;
+            std::memcpy(p, pairs + (value % 100) * 2, 2);
+            value /= 100;
+        }
+        if (value >= 10) {
+            p -= 2;
+            std::memcpy(p, pairs + value * 2, 2);
+        } else {
+            *--p = static_cast<char>('0' + value);
+        }
+        auto length = static_cast<size_t>(end - p);
+        std::memcpy(out, p, length);
+        return out + length;
+    }
+
+    static char *format_signed(char *out, int64_t value) {
+        if (value < 0) {
+            *out++ = '-';
+            return format_unsigned(out, static_cast<uint64_t>(0) - static_cast<uint64_t>(value));
+        }
+        return format_unsigned(out, static_cast<uint64_t>(value));
+    }
+
+    // Room for n more bytes in the active chunk
+    char *reserve(size_t n) {
+        if (this->chunks[this->active].length + n > this->chunks[this->active].capacity) {
+            if (this->active + 1 >= OUTPUT_MAX_CHUNKS) { this->commit(); }
+            if (this->chunks[this->active].length > 0) { this->active++; }
+            if (this->active == this->chunks.size()) {
+                this->chunks.push_back(allocate(std::max<size_t>(n, OUTPUT_CHUNK_SIZE)));
+            } else if (this->chunks[this->active].capacity < n) {
+                std::free(this->chunks[this->active].data);
+                this->chunks[this->active] = allocate(n);
+            }
+        }
+        Chunk &chunk = this->chunks[this->active];
+        return chunk.data + chunk.length;
+    }
+
+    void format(const Event &event) {
+        if (event.kind == Event::Kind::Decide) {
+            // At most 20 characters and a space per value
+            char *out = this->reserve(event.proposal.size() * 21 + 1);
+            event.proposal.for_each([&](ProposalValue value) {
+                out = format_signed(out, value);
+                *out++ = ' ';
+            });
+            *out++ = '\n';
+            this->chunks[this->active].length = static_cast<size_t>(out - this->chunks[this->active].data);
+            return;
+        }
+
+        char *out = this->reserve(64);
+        if (event.kind == Event::Kind::Broadcast) {
+            *out++ = 'b';
+        } else {
+            *out++ = 'd';
+            *out++ = ' ';
+            out = format_unsigned(out, event.sender);
+        }
+        *out++ = ' ';
+        out = format_unsigned(out, event.seq);
+        *out++ = '\n';
+        this->chunks[this->active].length = static_cast<size_t>(out - this->chunks[this->active].data);
+    }
+
+    // Write all formatted chunks with one writev
+    void commit() {
+        std::vector<struct iovec> iov;
+        for (size_t i = 0; i <= this->active; i++) {
+            if (this->chunks[i].length == 0) { continue; }
+            iov.push_back({this->chunks[i].data, this->chunks[i].length});
+        }
+
+        size_t next = 0;
+        while (next < iov.size()) {
+            ssize_t written = ::writev(this->fd, iov.data() + next, static_cast<int>(iov.size() - next));
+            if (written < 0) {
+                if (errno == EINTR) { continue; }
+                std::cerr << "Failed to write output: " << std::strerror(errno) << "\n";
+                break;
+            }
+            // Skip what a partial write took
+            auto remaining = static_cast<size_t>(written);
+            while (next < iov.size() && remaining >= iov[next].iov_len) {
+                remaining -= iov[next].iov_len;
+                next++;
+            }
+            if (next < iov.size()) {
+                iov[next].iov_base = static_cast<char *>(iov[next].iov_base) + remaining;
+                iov[next].iov_len -= remaining;
+            }
+        }
+
+        for (size_t i = 0; i <= this->active; i++) {
+            this->chunks[i].length = 0;
+        }
+        this->active = 0;
+    }
+
+    void run() {
+        ThreadPlacement::place("output");
+        Event event;
+        while (true) {
+            size_t drained = 0;
+            while (this->queue.try_pop(event)) {
+                this->format(event);
+                drained++;
+            }
+            if (drained > 0) {
+                this->commit();
+                this->committed.fetch_add(drained, std::memory_order_release);
+            } else if (!this->running) {
+                break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(OUTPUT_IDLE_SLEEP_US));
+            }
+        }
+    }
+
+    void push(Event &&event) {
+        while (!this->queue.try_push(std::move(event))) {
+            std::this_thread::yield(); // Writer is behind
+        }
+    }
 
 public:
-    OutputFile(const std::string file_name)
+    OutputFile(const std::string file_name) : queue(OUTPUT_QUEUE_CAPACITY)
     {
-        this->file.open(file_name, std::ofstream::out);
-        if (!this->file.is_open()) {
+        this->fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (this->fd < 0) {
             throw std::runtime_error("Failed to open output file: " + file_name);
         }
+        this->chunks.push_back(allocate(OUTPUT_CHUNK_SIZE));
+        this->writer = std::thread(&OutputFile::run, this);
     }
 
     ~OutputFile()
     {
-        this->flush();
         this->close();
+        for (auto &chunk : this->chunks) {
+            std::free(chunk.data);
+        }
     }
 
-    void write(const std::string &output)
+    // b seq
+    void broadcast(uint64_t seq)
     {
-        this->file << output;
+        Event event;
+        event.kind = Event::Kind::Broadcast;
+        event.seq = seq;
+        this->push(std::move(event));
     }
 
+    // d sender seq
+    void deliver(uint64_t sender, uint64_t seq)
+    {
+        Event event;
+        event.kind = Event::Kind::Deliver;
+        event.sender = sender;
+        event.seq = seq;
+        this->push(std::move(event));
+    }
+
+    // Decided set, space separated
+    void decide(Proposal proposal)
+    {
+        Event event;
+        event.kind = Event::Kind::Decide;
+        event.proposal = std::move(proposal);
+        this->push(std::move(event));
+    }
+
+    // Wait until every event pushed so far has been written
     void flush()
     {
-        this->file.flush();
+        size_t target = this->queue.pushed();
+        while (this->committed.load(std::memory_order_acquire) < target && this->running) {
+            std::this_thread::sleep_for(std::chrono::microseconds(OUTPUT_IDLE_SLEEP_US));
+        }
     }
 
+    // Write the remaining events and close the file
     void close()
     {
-        this->file.close();
+        if (!this->writer.joinable()) { return; }
+        this->running = false;
+        this->writer.join();
+        ::close(this->fd);
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "hosts.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
+
+#define PACER_INITIAL_RATE 50000.0 // Messages per second to a peer before any feedback
+#define PACER_MIN_RATE 2000.0 // Floor, so random (not congestion) loss still makes progress
+#define PACER_MAX_RATE 20000000.0
+#define PACER_INCREASE 1000.0 // Added to the rate per interval without loss (additive increase)
+#define PACER_DECREASE 0.5 // Rate factor per interval with loss (multiplicative decrease)
+#define PACER_LOSS_THRESHOLD 0.2 // Fraction of timed out transmissions that counts as congestion
+#define PACER_INTERVAL_NS 10000000 // Feedback interval, 10 ms
+#define PACER_BURST_NS 5000000 // Bucket capacity in time at the current rate, 5 ms
+#define PACER_MIN_BURST 64.0 // Bucket capacity in messages at least
+#define PACER_INITIAL_RTO_NS 10000000 // Retransmission timeout before the first RTT sample, 10 ms
+#define PACER_MIN_RTO_NS 5000000 // Above scheduling jitter, 5 ms
+#define PACER_MAX_RTO_NS 1000000000
+#define PACER_NO_PROBE std::numeric_limits<size_t>::max() // No message timed for an RTT sample
+
+/**
+ * @brief Per-peer send pacing for PerfectLink, AIMD on loss and ACK feedback
+ *
+ * @details A token bucket per peer holds the messages that may go out now,
+ * refilled at the peer's rate. Every PACER_INTERVAL_NS the rate adapts: if
+ * more than PACER_LOSS_THRESHOLD of the interval's transmissions were
+ * retransmissions after a timeout, it is halved, otherwise it grows by
+ * PACER_INCREASE if the bucket held messages back and ACKs came in. Only
+ * copies sent since the last decrease count as lost, as in TCP recovery:
+ * the backlog lost at the old rate is resent without halving again.
+ *
+ * A message is retransmitted only after the peer's retransmission timeout
+ * (RFC 6298: smoothed RTT plus four deviations). RTT is sampled on one
+ * message in flight per peer, timed from its first transmission to its ACK
+ * (never on a retransmitted one, Karn's rule).
+ *
+ * admit(), timed_out(), on_send() and adapt() run on the sending thread,
+ * on_ack() on the receiving thread. Links constructed after
+ * set_enabled(false) send and retransmit without pacing, as fast as they can.
+ */
+class Pacer {
+private:
+    struct Peer {
+        double rate{PACER_INITIAL_RATE}; // Messages per second
+        double tokens{PACER_MIN_BURST};
+        uint64_t refilled_ns{0};
+        uint64_t transmissions{0}, timeouts{0}; // In the current interval
+        uint64_t decreased_ns{0}; // Last multiplicative decrease
+        bool throttled{false}; // The bucket held messages back in the current interval
+        std::atomic<uint64_t> acks{0}; // In the current interval
+        std::atomic<size_t> probe_seq{PACER_NO_PROBE}; // Message timed for an RTT sample
+        std::atomic<uint64_t> probe_ns{0};
+        std::atomic<uint64_t> rto_ns{PACER_INITIAL_RTO_NS};
+        uint64_t srtt_ns{0}, rttvar_ns{0}; // Receiving thread only
+    };
+
+    std::unique_ptr<Peer[]> peers; // By host ID
+    std::vector<size_t> ids; // Of the hosts
+    uint64_t interval_start_ns{0};
+
+    static double burst(double rate) {
+        return std::max(PACER_MIN_BURST, rate * PACER_BURST_NS / 1e9);
+    }
+
+    static std::atomic<bool> &enabled() {
+        static std::atomic<bool> enabled{true};
+        return enabled;
+    }
+
+public:
+    Pacer(const Hosts &hosts) : peers(new Peer[hosts.get_id_bound()]) {
+        for (const auto &host : hosts) {
+            this->ids.push_back(host.get_id());
+            Metrics::shift(Gauge::PacerRate, static_cast<int64_t>(PACER_INITIAL_RATE));
+        }
+    }
+
+    ~Pacer() {
+        for (size_t id : this->ids) {
+            Metrics::shift(Gauge::PacerRate, -static_cast<int64_t>(this->peers[id].rate));
+        }
+    }
+
+    Pacer(const Pacer &) = delete;
+    Pacer &operator=(const Pacer &) = delete;
+
+    static void set_enabled(bool enable) { Pacer::enabled() = enable; }
+
+    static bool is_enabled() { return Pacer::enabled(); }
+
+    // Take a token for one message to `peer_id`, false if its bucket is empty
+    bool admit(size_t peer_id, uint64_t now_ns) {
+        Peer &peer = this->peers[peer_id];
+        if (peer.refilled_ns != 0 && now_ns > peer.refilled_ns) {
+            peer.tokens = std::min(burst(peer.rate), peer.tokens + peer.rate * static_cast<double>(now_ns - peer.refilled_ns) / 1e9);
+        }
+        peer.refilled_ns = now_ns;
+        if (peer.tokens < 1) {
+            peer.throttled = true;
+            Metrics::add(Counter::PacerThrottled);
+            return false;
+        }
+        peer.tokens -= 1;
+        return true;
+    }
+
+    // Whether a message first sent at `sent_ns` is due for retransmission
+    bool timed_out(size_t peer_id, uint64_t sent_ns, uint64_t now_ns) const {
+        return now_ns - sent_ns >= this->peers[peer_id].rto_ns.load(std::memory_order_relaxed);
+    }
+
+    // A message transmitted, `previous_ns` is its previous transmission (0 for the first)
+    void on_send(size_t peer_id, size_t seq_number, uint64_t now_ns, uint64_t previous_ns) {
+        Peer &peer = this->peers[peer_id];
+        peer.transmissions++;
+        if (previous_ns != 0) {
+            if (previous_ns >= peer.decreased_ns) { peer.timeouts++; }
+            Metrics::add(Counter::PlTimeouts);
+            // Karn's rule: an ACK of the probe could be for either copy
+            size_t probe = seq_number;
+            peer.probe_seq.compare_exchange_strong(probe, PACER_NO_PROBE, std::memory_order_relaxed);
+        } else if (peer.probe_seq.load(std::memory_order_relaxed) == PACER_NO_PROBE) {
+            peer.probe_ns.store(now_ns, std::memory_order_relaxed);
+            peer.probe_seq.store(seq_number, std::memory_order_release);
+        }
+    }
+
+    void on_ack(size_t peer_id, size_t seq_number) {
+        Peer &peer = this->peers[peer_id];
+        peer.acks.fetch_add(1, std::memory_order_relaxed);
+        size_t probe = seq_number;
+        if (!peer.probe_seq.compare_exchange_strong(probe, PACER_NO_PROBE, std::memory_order_acquire)) { return; }
+
+        uint64_t sample = monotonic_ns() - peer.probe_ns.load(std::memory_order_relaxed);
+        if (peer.srtt_ns == 0) {
+            peer.srtt_ns = sample;
+            peer.rttvar_ns = sample / 2;
+        } else {
+            uint64_t deviation = sample > peer.srtt_ns ? sample - peer.srtt_ns : peer.srtt_ns - sample;
+            peer.rttvar_ns = (3 * peer.rttvar_ns + deviation) / 4;
+            peer.srtt_ns = (7 * peer.srtt_ns + sample) / 8;
+        }
+        uint64_t rto = std::min<uint64_t>(PACER_MAX_RTO_NS, std::max<uint64_t>(PACER_MIN_RTO_NS, peer.srtt_ns + 4 * peer.rttvar_ns));
+        peer.rto_ns.store(rto, std::memory_order_relaxed);
+    }
+
+    // Adapt the rates once per interval
+    void adapt(uint64_t now_ns) {
+        if (now_ns - this->interval_start_ns < PACER_INTERVAL_NS) { return; }
+        this->interval_start_ns = now_ns;
+
+        for (size_t id : this->ids) {
+            Peer &peer = this->peers[id];
+            uint64_t acks = peer.acks.exchange(0, std::memory_order_relaxed);
+            double rate = peer.rate;
+            if (peer.timeouts > 0 && static_cast<double>(peer.timeouts) > PACER_LOSS_THRESHOLD * static_cast<double>(peer.transmissions)) {
+                rate = std::max(PACER_MIN_RATE, rate * PACER_DECREASE);
+                peer.decreased_ns = now_ns;
+            } else if (peer.throttled && acks > 0) {
+                rate = std::min(PACER_MAX_RATE, rate + PACER_INCREASE);
+            }
+            Metrics::shift(Gauge::PacerRate, static_cast<int64_t>(rate) - static_cast<int64_t>(peer.rate));
+            peer.rate = rate;
+            peer.transmissions = peer.timeouts = 0;
+            peer.throttled = false;
+        }
+    }
+
+    double get_rate(size_t peer_id) const { return this->peers[peer_id].rate; }
+};
@@ -132,6 +132,42 @@ public:
     return configPath_.c_str();
   }
 
+  // Optional `--name value` flags following the positional arguments, prints the usage if not a number
+  size_t option(const std::string &name, size_t defaultValue) const
+  {
+    checkParsed();
+    auto it = options_.find(name);
+    if (it == options_.end())
+    {
+      return defaultValue;
+    }
+
+    if (isPositiveNumber(it->second))
+    {
+      try
+      {
+        return std::stoul(it->second);
+      }
+      catch (std::invalid_argument const &e)
+      {
+      }
+      catch (std::out_of_range const &e)
+      {
+      }
+    }
+
+    std::cerr << "Invalid value `" << it->second << "` for --" << name << "\n";
+    help(argc, argv);
+    return defaultValue;
+  }
+
+  std::string option(const std::string &name, const std::string &defaultValue) const
+  {
+    checkParsed();
+    auto it = options_.find(name);
+    return it == options_.end() ? defaultValue : it->second;
+  }
+
   std::vector<Host> hosts()
   {
     std::ifstream hostsFile(hostsPath());
@@ -222,24 +258,39 @@ private:
       return false;
     }
 
+    if (!parseOptions())
+    {
+      return false;
+    }
+
     return true;
   }
 
-  void help(const int, char const *const *argv)
+  void help(const int, char const *const *argv) const
   {
     auto configStr = "CONFIG";
     std::cerr << "Usage: " << argv[0]
               << " --id ID --hosts HOSTS --output OUTPUT";
 
-    if (!withConfig)
-    {
-      std::cerr << "\n";
-    }
-    else
+    if (withConfig)
     {
-      std::cerr << " CONFIG\n";
+      std::cerr << " CONFIG";
     }
 
+    std::cerr << " [--name value]...\n"
+              << "Options:\n"
+              << "  --window K               Lattice agreement rounds in flight\n"
+              << "  --beb direct|tree        FIFO broadcast dissemination\n"
+              << "  --transport udp|shm      Shared memory to peers on this machine\n"
+              << "  --socket-buffer BYTES    UDP socket buffer size\n"
+              << "  --pacing on|off          Pace PerfectLink sends\n"
+              << "  --gso on|off             UDP segmentation offload\n"
+              << "  --metrics PATH           Write metrics as JSON lines\n"
+              << "  --metrics-interval MS    Interval between metrics dumps\n"
+              << "  --trace PATH             Write a Chrome trace\n"
+              << "  --cpus LIST              Pin threads to these cores (e.g. 0-3,8)\n"
+              << "  --numa-node N            Pin threads to a NUMA node, prefer its memory\n";
+
     exit(EXIT_FAILURE);
   }
 
@@ -322,6 +373,22 @@ private:
     return true;
   }
 
+  bool parseOptions()
+  {
+    int first = withConfig ? 8 : 7;
+    for (int i = first; i < argc; i += 2)
+    {
+      if (std::strncmp(argv[i], "--", 2) != 0 || i + 1 >= argc)
+      {
+        return false;
+      }
+
+      options_[std::string(argv[i] + 2)] = std::string(argv[i + 1]);
+    }
+
+    return true;
+  }
+
   bool isPositiveNumber(const std::string &s) const
   {
     return !s.empty() && std::find_if(s.begin(), s.end(), [](unsigned char c)
@@ -369,4 +436,5 @@ private:
   std::string hostsPath_;
   std::string outputPath_;
   std::string configPath_;
+  std::map<std::string, std::string> options_;
 };
@@ -3,93 +3,278 @@
 #include "hosts.hpp"
 #include "message.hpp"
 #include "message_set.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include "concurrent_queue.hpp"
 #include "fair_loss_link.hpp"
+#include "pacer.hpp"
+#include "stage.hpp"
+#include "thread_placement.hpp"
+
+#define PL_RETRANSMIT_INTERVAL_NS 1000000 // Event-driven mode: resend unacked messages every (simulated) millisecond
 
 /**
  * @brief PerfectLinkClass
  *
  * @details Send and receive messages over a network reliably
- * using the stop-and-wait for ACK protocol.
+ * using the stop-and-wait for ACK protocol. Messages (and ACKs) to the
+ * same host are batched into one datagram. Over an event-driven transport
+ * the link starts no threads: new messages go out in a task scheduled by
+ * send(), unacked ones are resent every PL_RETRANSMIT_INTERVAL_NS.
+ *
+ * The receiving thread only parses, acks and deduplicates; delivered
+ * messages go through a Stage, so plDeliver (and every layer above) runs on
+ * the stage's thread and a slow upper layer never holds up the socket.
+ *
+ * With threads, a Pacer spaces transmissions to each receiver and resends a
+ * message only once the receiver's retransmission timeout has passed since
+ * its last transmission, so bursts do not overflow the receiver's socket
+ * buffer (see pacer.hpp). Without pacing (Pacer::set_enabled(false)), the
+ * sending thread resends every unacked message on each pass.
  */
 class PerfectLink
 {
 private:
+  // A message to send and its last transmission (0 before the first)
+  struct Outgoing {
+    TransportMessage tm;
+    uint64_t sent_ns{0};
+  };
+
   Host host;
-  Hosts hosts;
+  const Hosts &hosts;
   FairLossLink link;
+  SendBuffer send_buffer; // Owned by the sending thread
+  SendBuffer ack_buffer; // Owned by the receiving thread
   MessageSet acked_messages; // Acked set of messages set<message_id> to receiver host_id
   MessageSet delivered_messages; // Delivered set of messages set<message_id> from sender host_id
-  ConcurrentQueue<TransportMessage> queue; // Queue of messages to send
+  ConcurrentQueue<Outgoing> queue; // Queue of messages to send
+  ConcurrentQueue<Outgoing> unacked; // Event-driven mode: sent, waiting for the next retransmission
+  std::unique_ptr<Pacer> pacer; // Threads with pacing only
+  std::vector<std::deque<Outgoing>> fresh, in_flight; // Threads with pacing: not sent yet, sent and not acked, by receiver ID
+  std::function<void(std::vector<TransportMessage>)> plDeliver; // Called once per received batch with its new messages
+  Stage<TransportMessage> delivery; // Runs plDeliver off the receiving thread
   std::thread sending_thread;
   std::thread receiving_thread;
-  bool continue_sending = true;
+  std::atomic<bool> continue_sending{true};
+  bool send_scheduled{false}, retransmit_scheduled{false}; // Event-driven mode only
+
+  // (Re-)send everything in `from` not acked yet, batched per receiver, and queue it on `to` for
+  // retransmission, false if there was nothing queued
+  bool send_pending(ConcurrentQueue<Outgoing> &from, ConcurrentQueue<Outgoing> &to)
+  {
+    auto outs = from.pop_all();
+    if (outs.empty()) {
+      return false;
+    }
+
+    for (auto &out : outs) {
+      size_t receiver_id = out.tm.get_receiver().get_id();
+      size_t seq_number = out.tm.get_seq_number();
+
+      if (!this->acked_messages.contains(receiver_id, seq_number)) {
+        // std::cout << "plSend: " << out.tm << std::endl;
+        out.tm.stamp();
+        this->send_buffer.add_message(out.tm);
+        to.push(out);
+        Metrics::add(Counter::PlTransmissions);
+      }
+    }
+    this->send_buffer.flush();
+    return true;
+  }
+
+  // Hand a full or flushed send buffer to the link, several datagrams at once if it segments
+  void send(const Host &receiver, const char *payload, size_t length, size_t segment_size)
+  {
+    if (segment_size == 0) {
+      this->link.send(receiver, payload, length);
+    } else {
+      this->link.send_segments(receiver, payload, length, segment_size);
+    }
+  }
+
+  // Threads with pacing: put `out` in a datagram and at the back of its receiver's in-flight messages
+  void transmit(Outgoing out, uint64_t now)
+  {
+    size_t receiver_id = out.tm.get_receiver().get_id();
+    out.tm.stamp();
+    this->send_buffer.add_message(out.tm);
+    this->pacer->on_send(receiver_id, out.tm.get_seq_number(), now, out.sent_ns);
+    out.sent_ns = now;
+    this->in_flight[receiver_id].push_back(std::move(out));
+    Metrics::add(Counter::PlTransmissions);
+  }
+
+  // Threads with pacing: per receiver, resend the timed out messages, then send new ones, as far as the
+  // pacer admits, false if nothing was sent or the pacer held messages back (the sending thread then sleeps)
+  bool send_paced()
+  {
+    for (auto &out : this->queue.pop_all()) {
+      this->fresh[out.tm.get_receiver().get_id()].push_back(std::move(out));
+    }
+    uint64_t now = monotonic_ns();
+    this->pacer->adapt(now);
+
+    bool sent = false, held = false;
+    for (const auto &receiver : this->hosts) {
+      size_t id = receiver.get_id();
+      auto &in_flight = this->in_flight[id], &fresh = this->fresh[id];
+
+      // In-flight messages are in transmission order, so the timed out ones are in front
+      while (!in_flight.empty()) {
+        if (this->acked_messages.contains(id, in_flight.front().tm.get_seq_number())) {
+          in_flight.pop_front();
+          continue;
+        }
+        if (!this->pacer->timed_out(id, in_flight.front().sent_ns, now)) { break; }
+        if (!this->pacer->admit(id, now)) { break; }
+        Outgoing out = std::move(in_flight.front());
+        in_flight.pop_front();
+        this->transmit(std::move(out), now);
+        sent = true;
+      }
+
+      while (!fresh.empty() && this->pacer->admit(id, now)) {
+        this->transmit(std::move(fresh.front()), now);
+        fresh.pop_front();
+        sent = true;
+      }
+      held = held || !fresh.empty() || (!in_flight.empty() && this->pacer->timed_out(id, in_flight.front().sent_ns, now));
+    }
+    this->send_buffer.flush();
+    return sent && !held;
+  }
 
   std::thread start_sending()
   {
     // std::cout << "Starting sending on " << host.get_address().to_string() << "\n";
 
     return std::thread([this]() {
+      ThreadPlacement::place("pl-send-" + std::to_string(this->host.get_id()));
       while (this->continue_sending) {
-        TransportMessage tm;
-        if (!this->queue.empty()) {
-          tm = this->queue.pop();
-
-          size_t receiver_id = tm.get_receiver().get_id();
-          size_t seq_number = tm.get_seq_number();
-
-          if (!this->acked_messages.contains(receiver_id, seq_number)) {
-            // std::cout << "plSend: " << tm << std::endl;
-            this->link.send(tm);
-            this->queue.push(tm);
-          }
+        bool busy = this->pacer ? this->send_paced() : this->send_pending(this->queue, this->queue);
+        if (!busy) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
         }
       }
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
     });
   }
 
-  std::thread start_receiving(std::function<void(TransportMessage)> plDeliver)
+  // Event-driven mode: send new messages right away, retransmit the unacked ones every interval
+  void schedule_sending()
   {
-    // std::cout << "Starting receiving on " << host.get_address().to_string() << "\n";
+    if (!this->send_scheduled) {
+      this->send_scheduled = true;
+      this->link.schedule(0, [this]() {
+        this->send_scheduled = false;
+        if (this->send_pending(this->queue, this->unacked)) { this->schedule_retransmit(); }
+      });
+    }
+  }
 
-    return std::thread([this, plDeliver]() {
-      this->link.start_receiving(
-        [this, plDeliver](TransportMessage tm) {
-          // Get sender and message id
-          size_t sender_id = tm.get_sender().get_id();
-          size_t seq_number = tm.get_seq_number();
-          if (tm.is_ack())
-          {
-            if (!this->acked_messages.contains(sender_id, seq_number)) {
-              this->acked_messages.insert(sender_id, seq_number);
-            }
-            return;
-          }
-
-          // Send ACK for received message
-          TransportMessage ack = TransportMessage::create_ack(tm);
-          this->link.send(ack);
-
-          // Deliver only if not previously delivered
-          if (!this->delivered_messages.contains(sender_id, seq_number))
-          {
-            this->delivered_messages.insert(sender_id, seq_number);
-            // std::cout << "plDeliver: " << tm << std::endl;
-            plDeliver(tm);
-          }
+  void schedule_retransmit()
+  {
+    if (!this->retransmit_scheduled) {
+      this->retransmit_scheduled = true;
+      this->link.schedule(PL_RETRANSMIT_INTERVAL_NS, [this]() {
+        this->retransmit_scheduled = false;
+        if (this->send_pending(this->unacked, this->unacked)) { this->schedule_retransmit(); }
       });
+    }
+  }
+
+  std::thread start_receiving()
+  {
+    // std::cout << "Starting receiving on " << host.get_address().to_string() << "\n";
+
+    return std::thread([this]() {
+      ThreadPlacement::place("pl-recv-" + std::to_string(this->host.get_id()));
+      this->link.start_receiving([this](std::vector<TransportMessage> tms) { this->flDeliver(std::move(tms)); });
     });
   }
 
+  void flDeliver(std::vector<TransportMessage> tms)
+  {
+    // Send ACKs for the whole batch first
+    for (auto &tm : tms) {
+      if (tm.is_ack()) { continue; }
+      TransportMessage ack = TransportMessage::create_ack(tm);
+      this->ack_buffer.add_message(ack);
+      Metrics::add(Counter::PlAcksSent);
+    }
+    this->ack_buffer.flush();
+
+    std::vector<TransportMessage> delivered;
+    for (auto &tm : tms) {
+      // Get sender and message id
+      size_t sender_id = tm.get_sender().get_id();
+      size_t seq_number = tm.get_seq_number();
+      if (tm.is_ack())
+      {
+        Metrics::add(Counter::PlAcksReceived);
+        if constexpr (LATENCY_TRACKING) { Metrics::record_since(Latency::PlAckRtt, tm.get_timestamp()); }
+        if (!this->acked_messages.contains(sender_id, seq_number)) {
+          this->acked_messages.insert(sender_id, seq_number);
+          if (this->pacer) { this->pacer->on_ack(sender_id, seq_number); }
+        }
+        continue;
+      }
+
+      // Deliver only if not previously delivered
+      if (!this->delivered_messages.contains(sender_id, seq_number))
+      {
+        this->delivered_messages.insert(sender_id, seq_number);
+        // std::cout << "plDeliver: " << tm << std::endl;
+        delivered.push_back(std::move(tm));
+      } else {
+        Metrics::add(Counter::PlDuplicates);
+      }
+    }
+    if (!delivered.empty()) {
+      this->delivery.push(std::move(delivered));
+    }
+  }
 
 public:
-  PerfectLink(Host host, Hosts hosts, std::function<void(TransportMessage)> plDeliver) : 
-    host(host), hosts(hosts), link(host, hosts), acked_messages(hosts), delivered_messages(hosts) {
-    this->receiving_thread = start_receiving(plDeliver);
+  // Deliver one message at a time
+  PerfectLink(Host host, const Hosts &hosts, std::function<void(TransportMessage)> plDeliver) :
+    PerfectLink(host, hosts, std::function<void(std::vector<TransportMessage>)>([plDeliver](std::vector<TransportMessage> tms) {
+      for (auto &tm : tms) { plDeliver(std::move(tm)); }
+    })) {}
+
+  // Deliver the new messages of each received datagram at once
+  PerfectLink(Host host, const Hosts &hosts, std::function<void(std::vector<TransportMessage>)> plDeliver) : 
+    host(host), hosts(hosts), link(host, hosts),
+    send_buffer(hosts, MAX_SEND_BUFFER_SIZE, [this](const Host &receiver, const char *payload, size_t length, size_t segment_size) {
+      this->send(receiver, payload, length, segment_size);
+    }, link.max_segments(MAX_SEND_BUFFER_SIZE)),
+    ack_buffer(hosts, MAX_SEND_BUFFER_SIZE, [this](const Host &receiver, const char *payload, size_t length, size_t segment_size) {
+      this->send(receiver, payload, length, segment_size);
+    }, link.max_segments(MAX_SEND_BUFFER_SIZE)),
+    acked_messages(hosts), delivered_messages(hosts), plDeliver(plDeliver),
+    delivery("pl-stage-" + std::to_string(host.get_id()), Gauge::PlStageDepth, [this](std::vector<TransportMessage> tms) {
+      TRACE_SPAN("plDeliver", tms.size());
+      this->plDeliver(std::move(tms));
+    }) {
+    this->delivery.start(!this->link.is_event_driven());
+    if (this->link.is_event_driven()) {
+      this->link.start_receiving([this](std::vector<TransportMessage> tms) { this->flDeliver(std::move(tms)); });
+      return;
+    }
+    if (Pacer::is_enabled()) {
+      this->pacer.reset(new Pacer(hosts));
+      this->fresh.resize(hosts.get_id_bound());
+      this->in_flight.resize(hosts.get_id_bound());
+    }
+    this->receiving_thread = start_receiving();
     this->sending_thread = start_sending();
-    this->receiving_thread.detach();
-    this->sending_thread.detach();
+  }
+
+  ~PerfectLink() {
+    this->shutdown();
+    if (this->receiving_thread.joinable()) { this->receiving_thread.join(); }
+    if (this->sending_thread.joinable()) { this->sending_thread.join(); }
   }
 
   void send(Message &m, Host receiver) {
@@ -101,12 +286,21 @@ public:
     TransportMessage tm(host, receiver, std::move(payload), length);
 
     // std::cout << "plEnqueue: " << tm << std::endl;
-    queue.push(tm);
+    queue.push(Outgoing{std::move(tm)});
+    Metrics::add(Counter::PlMessages);
+    if (this->link.is_event_driven()) { this->schedule_sending(); }
   }
 
+  // Whether the transport runs tasks through schedule() instead of threads
+  bool is_event_driven() const { return this->link.is_event_driven(); }
+
+  // Event-driven mode: run `task` on the event loop after `delay_ns`
+  void schedule(uint64_t delay_ns, std::function<void()> task) { this->link.schedule(delay_ns, std::move(task)); }
+
   void shutdown()
   {
     this->link.shutdown();
     this->continue_sending = false;
+    this->delivery.stop();
   }
 };
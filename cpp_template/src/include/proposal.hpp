@@ -0,0 +1,386 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "bitset_ops.hpp"
+#include "types.hpp"
+
+#define PROPOSAL_DIRECT_LIMIT (1 << 20) // Largest table for lock-free value lookups
+
+/**
+ * @brief Proposal Domain
+ *
+ * @details Maps proposal values to dense indices (0, 1, ...) in order of first
+ * appearance. A lattice agreement instance sees at most `ds` distinct values
+ * (LatticeAgreementConfig::get_num_distinct_elements), so indices stay small
+ * enough to be used as bit positions. Indices are local to a process, only the
+ * values themselves go over the wire.
+ *
+ * Values in [0, 4 * ds) (capped at PROPOSAL_DIRECT_LIMIT) also get a slot in a
+ * direct-mapped table, so looking them up takes one atomic load instead of the
+ * lock and a hash lookup. Other values only live in the hash map.
+ */
+class ProposalDomain {
+private:
+    std::unordered_map<ProposalValue, uint32_t> indices;
+    std::vector<ProposalValue> values;
+    size_t capacity;
+    std::atomic<size_t> num_values{0}; // values.size(), readable without the lock
+    size_t direct_size;
+    std::unique_ptr<std::atomic<uint32_t>[]> direct; // value -> index + 1, 0 if unassigned
+    mutable std::shared_mutex lock;
+
+    bool is_direct(ProposalValue value) const {
+        return value >= 0 && static_cast<size_t>(value) < this->direct_size;
+    }
+
+public:
+    ProposalDomain(size_t num_distinct_elements) :
+        capacity(std::max<size_t>(num_distinct_elements, 1)),
+        direct_size(std::min<size_t>(this->capacity * 4, PROPOSAL_DIRECT_LIMIT)),
+        direct(new std::atomic<uint32_t>[this->direct_size]()) {
+        this->indices.reserve(this->capacity);
+        this->values.reserve(this->capacity);
+    }
+
+    // Get the index of a value, assigning the next free one if it is new
+    uint32_t encode(ProposalValue value) {
+        if (this->is_direct(value)) {
+            uint32_t slot = this->direct[static_cast<size_t>(value)].load(std::memory_order_acquire);
+            if (slot != 0) { return slot - 1; }
+        } else {
+            std::shared_lock<std::shared_mutex> guard(this->lock);
+            auto it = this->indices.find(value);
+            if (it != this->indices.end()) { return it->second; }
+        }
+
+        std::unique_lock<std::shared_mutex> guard(this->lock);
+        auto result = this->indices.emplace(value, static_cast<uint32_t>(this->values.size()));
+        if (result.second) {
+            this->values.push_back(value);
+            this->num_values = this->values.size();
+            if (this->is_direct(value)) {
+                this->direct[static_cast<size_t>(value)].store(result.first->second + 1, std::memory_order_release);
+            }
+        }
+        return result.first->second;
+    }
+
+    // Get the index of a value without assigning one
+    bool lookup(ProposalValue value, uint32_t &index) const {
+        if (this->is_direct(value)) {
+            uint32_t slot = this->direct[static_cast<size_t>(value)].load(std::memory_order_acquire);
+            if (slot == 0) { return false; }
+            index = slot - 1;
+            return true;
+        }
+        std::shared_lock<std::shared_mutex> guard(this->lock);
+        auto it = this->indices.find(value);
+        if (it == this->indices.end()) { return false; }
+        index = it->second;
+        return true;
+    }
+
+    ProposalValue decode(uint32_t index) const {
+        std::shared_lock<std::shared_mutex> guard(this->lock);
+        return this->values[index];
+    }
+
+    // Call f(values), values[index] decoding an index, under a single shared lock. f must not call
+    // back into the domain at all: locking the shared_mutex again is undefined (and deadlocks once a
+    // writer waits), so keep f to reading the vector
+    template <typename F>
+    void with_values(F f) const {
+        std::shared_lock<std::shared_mutex> guard(this->lock);
+        f(static_cast<const std::vector<ProposalValue> &>(this->values));
+    }
+
+    // Number of bits a dense proposal has to cover (grows past ds if the config lied)
+    size_t get_capacity() const {
+        return std::max(this->capacity, this->num_values.load(std::memory_order_relaxed));
+    }
+};
+
+/**
+ * @brief Proposal (set of proposal values)
+ *
+ * @details Stores the dense indices of a ProposalDomain either as a sorted
+ * vector (sparse) or as a bitset over the whole domain (dense). A proposal
+ * starts sparse and switches to the bitset once the vector would take more
+ * memory than the bitset. Union and subset checks between dense proposals run
+ * over 64-bit words (four at a time with AVX2). Proposals only ever grow in
+ * lattice agreement, so there is no way back to the sparse representation.
+ */
+class Proposal {
+private:
+    ProposalDomain *domain{nullptr};
+    std::vector<uint32_t> sparse; // Sorted indices
+    std::vector<uint64_t> dense; // Bitset over indices
+    size_t count{0};
+    bool is_dense{false};
+
+    static size_t words_for(size_t bits) { return (bits + 63) / 64; }
+
+    bool test(uint32_t index) const {
+        if (this->is_dense) {
+            size_t word = index / 64;
+            return word < this->dense.size() && (this->dense[word] >> (index % 64)) & 1;
+        }
+        return std::binary_search(this->sparse.begin(), this->sparse.end(), index);
+    }
+
+    void set(uint32_t index) {
+        size_t word = index / 64;
+        if (word >= this->dense.size()) { this->dense.resize(word + 1, 0); }
+        uint64_t bit = uint64_t{1} << (index % 64);
+        this->count += (this->dense[word] & bit) ? 0 : 1;
+        this->dense[word] |= bit;
+    }
+
+    void densify() {
+        size_t bits = this->domain->get_capacity();
+        this->dense.assign(words_for(bits), 0);
+        this->count = 0;
+        for (auto index : this->sparse) {
+            this->set(index);
+        }
+        this->sparse.clear();
+        this->sparse.shrink_to_fit();
+        this->is_dense = true;
+    }
+
+    // Sparse storage costs 32 bits per element, dense storage 1 bit per domain element
+    void maybe_densify() {
+        if (!this->is_dense && this->domain != nullptr && this->sparse.size() * 32 >= this->domain->get_capacity()) {
+            this->densify();
+        }
+    }
+
+    // Default-constructed proposals have no domain until a union gives them one
+    ProposalDomain &get_domain() const {
+        if (this->domain == nullptr) { throw std::runtime_error("Proposal without a domain"); }
+        return *this->domain;
+    }
+
+    void insert_index(uint32_t index) {
+        if (this->is_dense) {
+            this->set(index);
+            return;
+        }
+        auto it = std::lower_bound(this->sparse.begin(), this->sparse.end(), index);
+        if (it != this->sparse.end() && *it == index) { return; }
+        this->sparse.insert(it, index);
+        this->count++;
+        this->maybe_densify();
+    }
+
+public:
+    Proposal() = default;
+    Proposal(ProposalDomain &domain) : domain(&domain) {}
+
+    void insert(ProposalValue value) {
+        this->insert_index(this->get_domain().encode(value));
+    }
+
+    // Insert n values at once: goes straight to the bitset if the result would be
+    // dense, otherwise one sort and merge instead of a shift per value
+    void insert(const ProposalValue *values, size_t n) {
+        this->get_domain(); // Throws without a domain
+        if (!this->is_dense && (this->sparse.size() + n) * 32 >= this->domain->get_capacity()) {
+            this->densify();
+        }
+        if (this->is_dense) {
+            for (size_t i = 0; i < n; i++) { this->set(this->domain->encode(values[i])); }
+            return;
+        }
+        size_t words = words_for(this->domain->get_capacity());
+        if (words <= 4 * n) {
+            // Small domain: sort by scattering into a bitset and reading it back
+            std::vector<uint64_t> bits(words, 0);
+            for (auto index : this->sparse) { bits[index / 64] |= uint64_t{1} << (index % 64); }
+            for (size_t i = 0; i < n; i++) {
+                uint32_t index = this->domain->encode(values[i]);
+                if (index / 64 >= bits.size()) { bits.resize(index / 64 + 1, 0); }
+                bits[index / 64] |= uint64_t{1} << (index % 64);
+            }
+            this->sparse.clear();
+            for (size_t word = 0; word < bits.size(); word++) {
+                for (uint64_t w = bits[word]; w != 0; w &= w - 1) {
+                    this->sparse.push_back(static_cast<uint32_t>(word * 64 + static_cast<size_t>(__builtin_ctzll(w))));
+                }
+            }
+            this->count = this->sparse.size();
+            return;
+        }
+        auto old_size = static_cast<std::ptrdiff_t>(this->sparse.size());
+        this->sparse.reserve(this->sparse.size() + n);
+        for (size_t i = 0; i < n; i++) { this->sparse.push_back(this->domain->encode(values[i])); }
+        std::sort(this->sparse.begin() + old_size, this->sparse.end());
+        if (old_size > 0) {
+            std::inplace_merge(this->sparse.begin(), this->sparse.begin() + old_size, this->sparse.end());
+        }
+        this->sparse.erase(std::unique(this->sparse.begin(), this->sparse.end()), this->sparse.end());
+        this->count = this->sparse.size();
+        this->maybe_densify();
+    }
+
+    bool contains(ProposalValue value) const {
+        uint32_t index;
+        return this->domain != nullptr && this->domain->lookup(value, index) && this->test(index);
+    }
+
+    // Remove all values, keeping the allocated storage for reuse
+    void clear() {
+        this->sparse.clear();
+        std::fill(this->dense.begin(), this->dense.end(), 0);
+        this->count = 0;
+    }
+
+    size_t size() const { return this->count; }
+    bool empty() const { return this->count == 0; }
+
+    // Values in index order, decoded under a single shared lock of the domain
+    std::vector<ProposalValue> values() const {
+        std::vector<ProposalValue> result;
+        if (this->count == 0) { return result; }
+        result.reserve(this->count);
+        this->get_domain().with_values([&](const std::vector<ProposalValue> &values) {
+            if (this->is_dense) {
+                for (size_t word = 0; word < this->dense.size(); word++) {
+                    for (uint64_t bits = this->dense[word]; bits != 0; bits &= bits - 1) {
+                        result.push_back(values[word * 64 + static_cast<size_t>(__builtin_ctzll(bits))]);
+                    }
+                }
+            } else {
+                for (auto index : this->sparse) {
+                    result.push_back(values[index]);
+                }
+            }
+        });
+        return result;
+    }
+
+    // Call f(value) for every value in the proposal (outside the domain's lock)
+    template <typename F>
+    void for_each(F f) const {
+        for (auto value : this->values()) { f(value); }
+    }
+
+    // Values in ascending order (rather than index order)
+    std::vector<ProposalValue> sorted_values() const {
+        std::vector<ProposalValue> values = this->values();
+        std::sort(values.begin(), values.end());
+        return values;
+    }
+
+    // this \ other
+    Proposal difference(const Proposal &other) const {
+        Proposal result;
+        result.domain = this->domain;
+        if (this->empty()) { return result; }
+
+        if (this->is_dense && other.is_dense) {
+            size_t n = std::min(this->dense.size(), other.dense.size());
+            result.dense = this->dense;
+            result.count = bitset_ops::difference(result.dense.data(), this->dense.data(), other.dense.data(), n);
+            for (size_t i = n; i < result.dense.size(); i++) {
+                result.count += static_cast<size_t>(__builtin_popcountll(result.dense[i]));
+            }
+            result.is_dense = true;
+            return result;
+        }
+
+        if (this->is_dense) {
+            for (size_t word = 0; word < this->dense.size(); word++) {
+                uint64_t bits = this->dense[word];
+                while (bits) {
+                    auto index = static_cast<uint32_t>(word * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+                    if (!other.test(index)) { result.sparse.push_back(index); }
+                    bits &= bits - 1;
+                }
+            }
+        } else {
+            for (auto index : this->sparse) {
+                if (!other.test(index)) { result.sparse.push_back(index); }
+            }
+        }
+        result.count = result.sparse.size();
+        result.maybe_densify();
+        return result;
+    }
+
+    // this = this U source
+    void set_union(const Proposal &source) {
+        if (source.empty()) { return; }
+        if (this->domain == nullptr) { this->domain = source.domain; }
+
+        if (!source.is_dense) {
+            if (this->is_dense) {
+                for (auto index : source.sparse) { this->set(index); }
+                return;
+            }
+            if (std::includes(this->sparse.begin(), this->sparse.end(), source.sparse.begin(), source.sparse.end())) { return; }
+            std::vector<uint32_t> merged;
+            merged.reserve(this->sparse.size() + source.sparse.size());
+            std::set_union(this->sparse.begin(), this->sparse.end(), source.sparse.begin(), source.sparse.end(),
+                           std::back_inserter(merged));
+            this->sparse = std::move(merged);
+            this->count = this->sparse.size();
+            this->maybe_densify();
+            return;
+        }
+
+        if (!this->is_dense) { this->densify(); }
+        if (this->dense.size() < source.dense.size()) { this->dense.resize(source.dense.size(), 0); }
+        size_t n = source.dense.size();
+        size_t count = bitset_ops::set_union(this->dense.data(), source.dense.data(), n);
+        for (size_t i = n; i < this->dense.size(); i++) {
+            count += static_cast<size_t>(__builtin_popcountll(this->dense[i]));
+        }
+        this->count = count;
+    }
+
+    // this <= superset
+    bool is_subset(const Proposal &superset) const {
+        if (this->count > superset.count) { return false; }
+        if (this->empty()) { return true; }
+
+        if (this->is_dense && superset.is_dense) {
+            size_t n = std::min(this->dense.size(), superset.dense.size());
+            for (size_t i = n; i < this->dense.size(); i++) {
+                if (this->dense[i]) { return false; }
+            }
+            return bitset_ops::is_subset(this->dense.data(), superset.dense.data(), n);
+        }
+
+        if (!this->is_dense && !superset.is_dense) {
+            return std::includes(superset.sparse.begin(), superset.sparse.end(), this->sparse.begin(), this->sparse.end());
+        }
+
+        if (!this->is_dense) {
+            for (auto index : this->sparse) {
+                if (!superset.test(index)) { return false; }
+            }
+            return true;
+        }
+
+        // Dense subset of a sparse superset: at most superset.count bits to check
+        for (size_t word = 0; word < this->dense.size(); word++) {
+            uint64_t bits = this->dense[word];
+            while (bits) {
+                auto index = static_cast<uint32_t>(word * 64 + static_cast<size_t>(__builtin_ctzll(bits)));
+                if (!superset.test(index)) { return false; }
+                bits &= bits - 1;
+            }
+        }
+        return true;
+    }
+};
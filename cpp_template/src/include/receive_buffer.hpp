@@ -8,7 +8,8 @@
 #include "hosts.hpp"
 #include "message.hpp"
 #include "message_set.hpp"
-#include "types.hpp"
+#include "metrics.hpp"
+#include "proposal.hpp"
 
 class BroadcastPriorityQueue {
 private:
@@ -59,8 +60,8 @@ private:
     }
 
 public:
-    ReceiveBuffer(Hosts hosts) {
-        for (const auto& host : hosts.get_hosts()) {
+    ReceiveBuffer(const Hosts &hosts) {
+        for (const auto& host : hosts) {
             this->messages[host.get_id()] = BroadcastPriorityQueue();
             this->next_seq_nums[host.get_id()] = SEQ_NUM_INIT;
         }
@@ -80,6 +81,7 @@ public:
             result.push_back(bm);
             this->next_seq_nums[source_id]++;
         }
+        Metrics::shift(Gauge::FrbBuffered, 1 - static_cast<int64_t>(result.size()));
         
         this->lock.unlock();
         return result;
@@ -88,31 +90,32 @@ public:
 
 class LatticeReceiveBuffer {
 private:
-    std::map<Round, Proposal> proposals;
+    std::map<Round, Proposal> proposals; // Decided rounds waiting on an earlier round, dropped once delivered
     Round next_round;
     std::mutex lock;
 
     bool has_next_round(Round round) {
-        return !this->proposals[round].empty();
+        return this->proposals.count(round) > 0;
     }
 
 public:
-    LatticeReceiveBuffer(Hosts hosts) {
+    LatticeReceiveBuffer(const Hosts &hosts) {
         this->proposals = std::map<Round, Proposal>();
         this->next_round = 0;
     }
 
-    std::vector<Proposal> deliver(ProposalMessage pm) {
+    std::vector<Proposal> deliver(Round round, Proposal decision) {
         this->lock.lock();
 
         // Add proposal to buffer
-        this->proposals[pm.get_round()] = pm.get_proposal();
+        this->proposals[round] = std::move(decision);
         
         // Collect all deliverable messages
         std::vector<Proposal> to_deliver;
         while (this->has_next_round(this->next_round)) {
-            auto proposal = this->proposals[this->next_round];
-            to_deliver.push_back(proposal);
+            auto it = this->proposals.find(this->next_round);
+            to_deliver.push_back(std::move(it->second));
+            this->proposals.erase(it);
             this->next_round++;
         }
         
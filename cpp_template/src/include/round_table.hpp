@@ -0,0 +1,237 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "hosts.hpp"
+#include "latency.hpp"
+#include "metrics.hpp"
+#include "proposal.hpp"
+
+#define LA_DEFAULT_STRIPES 64 // Locks shared by the rounds of a RoundTable
+#define ROUND_TABLE_DECIDED_WINDOWS 64 // Retired rounds whose acceptor value is kept, in windows
+#define ROUND_TABLE_SILENT_NS 1000000000 // A host not heard from this long no longer holds proposers back
+
+/**
+ * @brief Proposer and acceptor state of one lattice agreement round
+ */
+struct alignas(64) RoundState {
+    Round round{0};
+    bool in_use{false};
+    bool active{false};
+    size_t ack_count{0};
+    size_t nack_count{0};
+    ProposalNumber active_proposal_number{0};
+    uint64_t proposed_at{0}; // monotonic_ns() of the local proposal
+    Proposal active_proposal;
+    Proposal accepted_proposal;
+
+    // Take over the slot for a new round, keeping the proposals' storage
+    void reset(Round round) {
+        this->round = round;
+        this->in_use = true;
+        this->active = false;
+        this->ack_count = 0;
+        this->nack_count = 0;
+        this->active_proposal_number = 0;
+        this->proposed_at = 0;
+        this->active_proposal.clear();
+        this->accepted_proposal.clear();
+    }
+};
+
+/**
+ * @brief Per-round state of lattice agreement, with striped locking
+ *
+ * @details Round states live in a ring of `window` slots (slot = round % window)
+ * that is allocated once and reused. Rounds whose slot is still taken go to an
+ * overflow map. Each slot belongs to one of `stripes` locks (stripe = slot %
+ * stripes), and so does the overflow of its rounds. The proposer thread, the
+ * delivery thread and retire() therefore only meet on the same stripe, and
+ * messages of different rounds can be processed in parallel. With one stripe
+ * the table behaves like a single global lock. The ack and nack counts of a
+ * round stay plain fields under its stripe lock: finding the round and
+ * deciding it need the lock anyway, and counting outside it could credit an
+ * ack to the next round that takes over the slot.
+ *
+ * A round's state is retired as soon as the local process has decided it and
+ * every round before (see retire()), so a crashed or slow peer never holds on
+ * to slots. Only the acceptor's value (accepted proposal union decision) is
+ * kept, one Proposal per round, to answer peers that still propose for it
+ * (see with_decided()). These values are trimmed once every host has decided
+ * their round (see update_decided_below()), and in any case past the last
+ * `window * ROUND_TABLE_DECIDED_WINDOWS` retired rounds, so a crashed host
+ * costs bounded memory. These values and the host watermarks have a lock of
+ * their own, taken after a stripe lock if both are needed.
+ *
+ * A proposal for a round whose value was dropped that way is left unanswered
+ * (counted as la_expired): acking or nacking it without the acceptor value
+ * could break comparability. So that no live host gets there, a proposer
+ * stays within that horizon of the slowest host it heard from in the last
+ * ROUND_TABLE_SILENT_NS (see in_horizon()): a slow host holds the others
+ * back, a crashed one only until it has been silent that long. A host that
+ * was silent (paused) while the others ran a whole horizon ahead hits expired
+ * rounds once it is back: it stops deciding, as if it had crashed, and the
+ * others are not held up.
+ */
+class RoundTable {
+private:
+    struct alignas(64) Stripe {
+        std::mutex lock;
+        std::map<Round, RoundState> overflow; // Rounds of this stripe whose slot is taken
+    };
+
+    size_t window;
+    std::vector<RoundState> ring;
+    std::vector<Stripe> stripes;
+    const Hosts &hosts;
+    std::atomic<Round> retired_below{0}; // The local process decided every round below
+    std::deque<Proposal> decided; // Acceptor value of the retired rounds from decided_from
+    size_t max_decided; // Acceptor values kept at most
+    Round decided_from{0}; // Round of decided.front(), every round below is dropped
+    Round everyone_decided_below{0}; // Every host decided every round below
+    std::vector<Round> host_decided_below; // Decision watermark per host id
+    std::vector<uint64_t> host_heard_ns; // monotonic_ns() of the last watermark per host id
+    std::mutex lock; // Guards the retired rounds' values and the host watermarks
+
+    Stripe &stripe_of(Round round) {
+        return this->stripes[(round % this->window) % this->stripes.size()];
+    }
+
+    // Get the state of a round (requires the stripe lock), nullptr once the round is retired
+    RoundState *find(Stripe &stripe, Round round) {
+        if (round < this->retired_below) { return nullptr; }
+
+        RoundState &slot = this->ring[round % this->window];
+        if (slot.in_use && slot.round == round) { return &slot; }
+        if (!stripe.overflow.empty()) {
+            auto it = stripe.overflow.find(round);
+            if (it != stripe.overflow.end()) { return &it->second; }
+        }
+        if (!slot.in_use) {
+            slot.reset(round);
+            return &slot;
+        }
+
+        RoundState &state = stripe.overflow[round];
+        state.reset(round);
+        return &state;
+    }
+
+public:
+    RoundTable(size_t window, const Hosts &hosts, size_t stripes = LA_DEFAULT_STRIPES) :
+        window(std::max<size_t>(window, 1)),
+        ring(this->window),
+        stripes(std::min(std::max<size_t>(stripes, 1), this->window)),
+        hosts(hosts),
+        max_decided(this->window * ROUND_TABLE_DECIDED_WINDOWS),
+        host_decided_below(hosts.get_id_bound(), 0),
+        host_heard_ns(hosts.get_id_bound(), monotonic_ns()) {}
+
+    // Run f(state) under the round's stripe lock, false if the round is retired
+    template <typename F>
+    bool with_round(Round round, F f) {
+        Stripe &stripe = this->stripe_of(round);
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        RoundState *state = this->find(stripe, round);
+        if (state == nullptr) { return false; }
+        f(*state);
+        return true;
+    }
+
+    // Run f(accepted) on a retired round's acceptor value, false if every host decided the round or it expired
+    template <typename F>
+    bool with_decided(Round round, F f) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if (round < this->decided_from) {
+            if (round >= this->everyone_decided_below) { Metrics::add(Counter::LaExpired); }
+            return false;
+        }
+        if (round >= this->decided_from + this->decided.size()) { return false; }
+        f(this->decided[round - this->decided_from]);
+        return true;
+    }
+
+    // Free the state of the next round the local process decided, in round order
+    void retire(Round round) {
+        Stripe &stripe = this->stripe_of(round);
+        std::lock_guard<std::mutex> guard(stripe.lock);
+        if (round != this->retired_below) { return; }
+        RoundState *state = this->find(stripe, round);
+
+        Proposal accepted = state->accepted_proposal;
+        accepted.set_union(state->active_proposal);
+        {
+            std::lock_guard<std::mutex> decided_guard(this->lock);
+            this->decided.push_back(std::move(accepted));
+            if (this->decided.size() > this->max_decided) {
+                this->decided.pop_front();
+                this->decided_from++;
+            }
+        }
+
+        if (state == &this->ring[round % this->window]) {
+            state->in_use = false;
+        } else {
+            stripe.overflow.erase(round);
+        }
+        this->retired_below = round + 1;
+    }
+
+    // Record a host's decision watermark, trimming the values of the rounds every host decided.
+    // True if the watermark moved, which may bring rounds into the horizon
+    bool update_decided_below(size_t host_id, Round round) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if (host_id >= this->host_decided_below.size()) { return false; }
+        this->host_heard_ns[host_id] = monotonic_ns();
+        if (round <= this->host_decided_below[host_id]) { return false; }
+        this->host_decided_below[host_id] = round;
+
+        Round decided_below = round;
+        for (const auto &host : this->hosts) {
+            decided_below = std::min(decided_below, this->host_decided_below[host.get_id()]);
+        }
+        this->everyone_decided_below = decided_below;
+        while (this->decided_from < decided_below && !this->decided.empty()) {
+            this->decided.pop_front();
+            this->decided_from++;
+        }
+        return true;
+    }
+
+    // Whether the round is within the kept acceptor values of every host heard from lately
+    bool in_horizon(Round round) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        if (round < this->everyone_decided_below + this->max_decided) { return true; }
+        uint64_t now = monotonic_ns();
+        for (const auto &host : this->hosts) {
+            size_t id = host.get_id();
+            if (now - this->host_heard_ns[id] < ROUND_TABLE_SILENT_NS && round >= this->host_decided_below[id] + this->max_decided) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    Round get_retired_below() const { return this->retired_below; }
+
+    // Round states held outside the ring
+    size_t get_overflow_count() {
+        size_t count = 0;
+        for (auto &stripe : this->stripes) {
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            count += stripe.overflow.size();
+        }
+        return count;
+    }
+
+    // Acceptor values kept for retired rounds
+    size_t get_decided_count() {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return this->decided.size();
+    }
+};
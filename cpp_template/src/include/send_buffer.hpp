@@ -3,94 +3,123 @@
 #include "message.hpp"
 #include "hosts.hpp"
 
-#define MAX_MESSAGE_COUNT 8
+#define MAX_MESSAGE_COUNT 64
+#define SEND_BUFFER_PADDING (uint64_t(1) << 63) // Length flag of a padding frame, its bytes are skipped
 
 /**
  * @brief Buffer for sending messages to hosts
- * 
+ *
  * @details The send buffer is a buffer for sending messages to hosts. It is used to
- * batch messages to the same host into a single buffer. This should give
- * a constant performance improvement by MAX_MESSAGE_COUNT.
+ * batch messages to the same host into a single datagram of at most `capacity`
+ * bytes (or MAX_MESSAGE_COUNT messages), laid out as [length (8B)][message]...
+ * A full buffer is handed to the send callback right away, the rest goes out on
+ * flush(). A message larger than the capacity is sent on its own. Not thread-safe:
+ * every sending thread owns its buffer.
+ *
+ * With `segments` > 1, a full datagram is padded to exactly `capacity` bytes
+ * with a padding frame and the next one starts right after it, and the
+ * callback gets all of them at once with the segment size (`capacity`) once
+ * `segments` are full or on flush(), for a segmented (GSO) send. Datagrams are
+ * then contiguous and self-delimiting, so deserialize() also parses several
+ * datagrams coalesced by the receiving kernel (GRO). The segment size is 0
+ * for a single datagram.
  */
 class SendBuffer {
 private:
-    Hosts hosts;
+    struct Slot {
+        Host receiver;
+        uint64_t size{0};
+        std::unique_ptr<char[]> buffer;
+        size_t message_count{0}; // In the current datagram
+        uint64_t start{0}; // Offset of the current datagram
+    };
+
     uint64_t capacity;
-    std::unordered_map<size_t, uint64_t> sizes;
-    std::unordered_map<size_t, std::unique_ptr<char[]>> buffers;
-    std::unordered_map<size_t, size_t> message_counts;
-    std::mutex lock;
+    size_t segments;
+    uint64_t frame_limit; // Largest frame a datagram takes, leaves room for a padding frame when segmenting
+    const Hosts &hosts;
+    std::vector<Slot> slots; // Indexed by receiver host ID
+    std::function<void(const Host &, const char *, size_t, size_t)> send;
+
+    // Close the current datagram: pad it and start the next one, or send them all
+    void next_datagram(size_t receiver_id) {
+        Slot &slot = this->slots[receiver_id];
+        if (slot.start + this->capacity >= this->segments * this->capacity) {
+            this->flush(receiver_id);
+            return;
+        }
+
+        uint64_t padding = this->capacity - (slot.size - slot.start) - sizeof(uint64_t);
+        uint64_t length = SEND_BUFFER_PADDING | padding;
+        std::memcpy(slot.buffer.get() + slot.size, &length, sizeof(length));
+        std::memset(slot.buffer.get() + slot.size + sizeof(length), 0, padding);
+        slot.start += this->capacity;
+        slot.size = slot.start;
+        slot.message_count = 0;
+    }
+
 public:
-    SendBuffer(Hosts hosts, uint64_t initial_capacity) : hosts(hosts), capacity(initial_capacity) {
-        // Initialize buffer sizes, buffers, and message counts for all hosts
-        for (auto host : hosts.get_hosts()) {
-            size_t host_id = host.get_id();
-            this->sizes.emplace(host_id, 0);
-            this->buffers.emplace(host_id, std::unique_ptr<char[]>(new char[initial_capacity]));
-            this->message_counts.emplace(host_id, 0);
+    SendBuffer(const Hosts &hosts, uint64_t capacity, std::function<void(const Host &, const char *, size_t, size_t)> send, size_t segments = 1) :
+        capacity(capacity), segments(std::max<size_t>(1, segments)), frame_limit(this->segments > 1 ? capacity - sizeof(uint64_t) : capacity),
+        hosts(hosts), slots(hosts.get_id_bound()), send(send) {
+        // Allocate a buffer for every host
+        for (const auto &host : hosts) {
+            Slot &slot = this->slots[host.get_id()];
+            slot.receiver = host;
+            slot.buffer.reset(new char[this->segments * capacity]);
         }
-    }            
+    }
 
-    std::unique_ptr<char[]> add_message(TransportMessage message, uint64_t &payload_length, const bool &reset = false)
+    void add_message(TransportMessage &message)
     {
         // Serialize the message
         uint64_t serialized_length;
-        std::unique_ptr<char[]> serialized_message = message.serialize(serialized_length);
-        std::cout << "Serialized TM: " << message << " (" << serialized_length << " bytes)" << std::endl;
+        auto serialized_message = message.serialize(serialized_length);
+        uint64_t framed_length = sizeof(serialized_length) + serialized_length;
 
-        // Get host id of receiver
+        // Get the receiver's slot
         size_t receiver_id = message.get_receiver().get_id();
+        Slot &slot = this->slots[receiver_id];
+
+        // Oversized messages get a datagram of their own
+        if (framed_length > this->frame_limit) {
+            this->flush(receiver_id);
+            std::unique_ptr<char[]> datagram(new char[framed_length]);
+            std::memcpy(datagram.get(), &serialized_length, sizeof(serialized_length));
+            std::memcpy(datagram.get() + sizeof(serialized_length), serialized_message.get(), serialized_length);
+            this->send(slot.receiver, datagram.get(), framed_length, 0);
+            return;
+        }
+
+        // Make room for the message
+        bool has_space = slot.size - slot.start + framed_length <= this->frame_limit;
+        bool has_room = slot.message_count < MAX_MESSAGE_COUNT;
+        if (!has_space || !has_room) {
+            this->next_datagram(receiver_id);
+        }
+
+        // Add the message to the buffer
+        char *buffer = slot.buffer.get() + slot.size;
+        std::memcpy(buffer, &serialized_length, sizeof(serialized_length));
+        std::memcpy(buffer + sizeof(serialized_length), serialized_message.get(), serialized_length);
+        slot.size += framed_length;
+        slot.message_count++;
+    }
+
+    // Send the buffered messages to one host
+    void flush(size_t receiver_id) {
+        Slot &slot = this->slots[receiver_id];
+        if (slot.size == 0) { return; }
+        this->send(slot.receiver, slot.buffer.get(), slot.size, slot.start > 0 ? this->capacity : 0);
+        slot.size = 0;
+        slot.start = 0;
+        slot.message_count = 0;
+    }
 
-        // Acquire lock to manipulate buffer
-        this->lock.lock();
-
-        // Check if buffer has space for the message
-        bool has_space = sizes[receiver_id] + serialized_length <= capacity;
-        bool has_room = this->message_counts[receiver_id] < MAX_MESSAGE_COUNT;
-
-        // If there is space, add the message
-        if (has_space && has_room)
-        {
-            // Add the message to the buffer, if there is space
-            std::memcpy(this->buffers[receiver_id].get() + this->sizes[receiver_id], &serialized_length, sizeof(serialized_length));
-            std::memcpy(this->buffers[receiver_id].get() + this->sizes[receiver_id] + sizeof(serialized_length), serialized_message.get(), serialized_length);
-            this->sizes[receiver_id] += sizeof(serialized_length) + serialized_length;
-            this->message_counts[receiver_id]++;
-            this->lock.unlock();
-            std::cout << "Adding message to buffer (" << this->message_counts[receiver_id] << " messages)" << std::endl;
-            
-            // Return empty buffer (send buffer is not ready yet)
-            if (!reset)
-            {
-                std::unique_ptr<char[]> buffer_payload(new char[0]);
-                payload_length = 0;
-                return buffer_payload;
-            } else {
-                // Copy the buffer to return
-                std::unique_ptr<char[]> buffer_payload(new char[this->sizes[receiver_id]]);
-                std::memcpy(buffer_payload.get(), this->buffers[receiver_id].get(), this->sizes[receiver_id]);
-                payload_length = this->sizes[receiver_id];
-                this->sizes[receiver_id] = 0;
-                this->message_counts[receiver_id] = 0;
-
-                return buffer_payload;
-            }
-        } else { // Otherwise, return the full buffer and reset with new message
-            // Copy the buffer to return
-            // std::cout << "Copying buffer to return" << std::endl;
-            std::unique_ptr<char[]> buffer_payload(new char[this->sizes[receiver_id]]);
-            std::memcpy(buffer_payload.get(), this->buffers[receiver_id].get(), this->sizes[receiver_id]);
-            payload_length = this->sizes[receiver_id];
-
-            // std::cout << "Resetting buffer with new message" << std::endl;
-            // Reset the buffer with the new message
-            std::memcpy(this->buffers[receiver_id].get(), &serialized_length, sizeof(serialized_length));
-            std::memcpy(this->buffers[receiver_id].get() + sizeof(serialized_length), serialized_message.get(), serialized_length);
-            this->sizes[receiver_id] = sizeof(serialized_length) + serialized_length;
-            this->message_counts[receiver_id] = 1;
-
-            this->lock.unlock();
-            return buffer_payload;
+    // Send the buffered messages to all hosts
+    void flush() {
+        for (const auto &host : this->hosts) {
+            this->flush(host.get_id());
         }
     }
 
@@ -98,11 +127,14 @@ public:
         std::vector<TransportMessage> messages;
         size_t offset = 0;
         uint64_t message_length;
-        while (offset < received_length) {
+        while (offset + sizeof(message_length) <= received_length) {
             std::memcpy(&message_length, buffer + offset, sizeof(message_length));
-            TransportMessage message = TransportMessage::deserialize(buffer + offset + sizeof(message_length), message_length);
-            messages.push_back(message);
-            offset += sizeof(message_length) + message_length;
+            offset += sizeof(message_length);
+            bool padding = (message_length & SEND_BUFFER_PADDING) != 0;
+            message_length &= ~SEND_BUFFER_PADDING;
+            if (message_length > received_length - offset) { break; } // Truncated datagram
+            if (!padding) { messages.emplace_back(buffer + offset); }
+            offset += message_length;
         }
 
         return messages;
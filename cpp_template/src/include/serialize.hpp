@@ -1,3 +1,8 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
 /**
  * @brief: Helper to serialize/ deserialize
  */
@@ -16,4 +21,44 @@ struct Serializable {
         offset += sizeof(T);
         return value;
     }
-};
\ No newline at end of file
+};
+
+/**
+ * @brief: Helper to serialize/ deserialize variable-length integers (LEB128)
+ *
+ * @details Seven bits per byte, the high bit marks that more bytes follow.
+ * Signed values go through zigzag encoding first so small negatives stay short.
+ */
+struct Varint {
+    static size_t length(uint64_t value) {
+        size_t length = 1;
+        while (value >= 0x80) { value >>= 7; length++; }
+        return length;
+    }
+
+    static void serialize(char* buffer, size_t& offset, uint64_t value) {
+        while (value >= 0x80) {
+            buffer[offset++] = static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        buffer[offset++] = static_cast<char>(value);
+    }
+
+    static uint64_t deserialize(const char* buffer, size_t& offset) {
+        uint64_t value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            auto byte = static_cast<uint8_t>(buffer[offset++]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) { break; }
+        }
+        return value;
+    }
+
+    static uint64_t zigzag(int64_t value) {
+        return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+    }
+
+    static int64_t unzigzag(uint64_t value) {
+        return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+    }
+};
@@ -0,0 +1,316 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "latency.hpp"
+#include "thread_placement.hpp"
+#include "transport.hpp"
+
+#define SHM_RING_BYTES (1 << 15) // Per (receiver, sender) pair, a full ring drops datagrams like a full socket buffer.
+                                // Kept small: deeper rings only queue stale PerfectLink retransmissions (1 MB was 5x slower)
+#define SHM_MAGIC 0x64615f73686d0001ULL // Written last by the receiver once its inbox is ready
+#define SHM_WAIT_TIMEOUT_MS 100 // Upper bound on a receiver's sleep, in case a wakeup is lost to a crashed sender
+#define SHM_RETRY_OPEN_NS 100000000 // How often a sender retries the inbox of a peer that has not created it yet
+#define SHM_UDP_SLOT 0 // Ring of the receiver's own UDP forwarder (host IDs start at 1)
+#define SHM_MAX_OVERSIZED 64 // Queued UDP datagrams too large for a ring, more are dropped like on a full ring
+
+/**
+ * @brief Single-producer/single-consumer ring of datagrams in shared memory
+ *
+ * @details Positions only grow, records are a 4-byte length and the payload,
+ * padded to 8 bytes. A record that does not fit before the end of the buffer
+ * is preceded by a wrap marker. The ring lives in a mapping shared by two
+ * processes, so it only holds lock-free atomics and bytes.
+ */
+struct ShmRing {
+    static constexpr uint32_t WRAP = UINT32_MAX;
+
+    alignas(64) std::atomic<uint64_t> head; // Read position, written by the consumer
+    alignas(64) std::atomic<uint64_t> tail; // Write position, written by the producer
+    alignas(64) char data[SHM_RING_BYTES];
+
+    static size_t record_size(size_t length) {
+        return (sizeof(uint32_t) + length + 7) & ~static_cast<size_t>(7);
+    }
+
+    // Whether a datagram of this length fits into an empty ring
+    static bool fits(size_t length) {
+        return record_size(length) <= SHM_RING_BYTES;
+    }
+
+    // Append a datagram, false if the ring is full
+    bool push(const char *payload, size_t length) {
+        uint64_t tail = this->tail.load(std::memory_order_relaxed);
+        uint64_t head = this->head.load(std::memory_order_acquire);
+        size_t record = record_size(length);
+        size_t offset = static_cast<size_t>(tail % SHM_RING_BYTES);
+        size_t skip = offset + record > SHM_RING_BYTES ? SHM_RING_BYTES - offset : 0;
+        if (record > SHM_RING_BYTES || tail + skip + record - head > SHM_RING_BYTES) { return false; }
+
+        if (skip > 0) {
+            std::memcpy(this->data + offset, &WRAP, sizeof(WRAP));
+            tail += skip;
+            offset = 0;
+        }
+        auto length32 = static_cast<uint32_t>(length);
+        std::memcpy(this->data + offset, &length32, sizeof(length32));
+        std::memcpy(this->data + offset + sizeof(length32), payload, length);
+        this->tail.store(tail + record, std::memory_order_release);
+        return true;
+    }
+
+    // Take the oldest datagram, -1 if the ring is empty
+    ssize_t pop(char *buffer, size_t capacity) {
+        uint64_t head = this->head.load(std::memory_order_relaxed);
+        if (head == this->tail.load(std::memory_order_acquire)) { return -1; }
+
+        size_t offset = static_cast<size_t>(head % SHM_RING_BYTES);
+        uint32_t length;
+        std::memcpy(&length, this->data + offset, sizeof(length));
+        if (length == WRAP) {
+            head += SHM_RING_BYTES - offset;
+            offset = 0;
+            std::memcpy(&length, this->data, sizeof(length));
+        }
+        size_t copied = std::min<size_t>(length, capacity);
+        std::memcpy(buffer, this->data + offset + sizeof(length), copied);
+        this->head.store(head + record_size(length), std::memory_order_release);
+        return static_cast<ssize_t>(copied);
+    }
+};
+
+/**
+ * @brief A receiver's shared memory segment: a doorbell and one ring per sender ID
+ */
+struct ShmInbox {
+    alignas(64) std::atomic<uint64_t> magic;
+    uint64_t slots;
+    alignas(64) std::atomic<uint32_t> doorbell; // Futex word, bumped to wake a sleeping receiver
+    std::atomic<uint32_t> waiting; // Whether the receiver is (about to go) asleep
+
+    static size_t size(size_t slots) {
+        return sizeof(ShmInbox) + slots * sizeof(ShmRing);
+    }
+
+    ShmRing &ring(size_t slot) {
+        return reinterpret_cast<ShmRing *>(reinterpret_cast<char *>(this) + sizeof(ShmInbox))[slot];
+    }
+
+    void wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (this->waiting.load(std::memory_order_relaxed)) {
+            this->doorbell.fetch_add(1, std::memory_order_relaxed);
+            syscall(SYS_futex, reinterpret_cast<uint32_t *>(&this->doorbell), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+        }
+    }
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<uint32_t>::is_always_lock_free,
+              "Shared memory rings need lock-free atomics");
+
+/**
+ * @brief Transport through shared memory for peers on this machine, UDP for the others
+ *
+ * @details Every host creates an inbox in /dev/shm named after its address,
+ * with one SPSC ring per sender ID. A datagram to a peer on a loopback
+ * address goes into that peer's ring for the local host ID (producers in
+ * this process take turns on a per-peer lock), then a futex wakes the
+ * peer if it sleeps. Datagrams to remote peers, or to local peers whose
+ * inbox does not exist (not started, or on UDP), go over UDP. So do datagrams
+ * larger than a ring, which UDP carries up to 64 KB. The UDP socket is bound
+ * as usual, and a forwarder thread moves what arrives on it into the host's
+ * own inbox, so receive() only reads rings, plus a process-local queue for
+ * the datagrams too large for a ring. Selected with `--transport shm`.
+ */
+class ShmTransport : public Transport {
+private:
+    struct Peer {
+        bool local{false};
+        std::mutex lock; // Producers of this process on the peer's ring
+        ShmInbox *inbox{nullptr};
+        uint64_t next_attempt_ns{0};
+    };
+
+    size_t local_id;
+    size_t slots;
+    std::string name;
+    ShmInbox *inbox{nullptr};
+    UdpTransport udp; // Without coalesced receives, a ring slot holds one datagram
+    std::vector<std::unique_ptr<Peer>> peers; // Indexed by host ID
+    std::mutex oversized_lock;
+    std::deque<std::vector<char>> oversized; // Datagrams from the UDP socket too large for a ring
+    std::atomic<bool> has_oversized{false};
+    std::atomic<bool> closed{false};
+    size_t next_slot{0}; // Receiver only, where the next scan starts
+    std::thread forwarder;
+
+    static std::string inbox_name(const Host &host) {
+        return "/da_shm_" + std::to_string(host.get_address().ip) + "_" + std::to_string(static_cast<int>(host.get_address().port));
+    }
+
+    static ShmInbox *map(int fd, size_t slots) {
+        void *memory = mmap(nullptr, ShmInbox::size(slots), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        return memory == MAP_FAILED ? nullptr : static_cast<ShmInbox *>(memory);
+    }
+
+    // Map a peer's inbox (requires the peer's lock), nullptr if it is not there (yet)
+    ShmInbox *open_inbox(const Host &receiver, Peer &peer) {
+        uint64_t now = monotonic_ns();
+        if (peer.inbox != nullptr || now < peer.next_attempt_ns) { return peer.inbox; }
+        peer.next_attempt_ns = now + SHM_RETRY_OPEN_NS;
+
+        int fd = shm_open(inbox_name(receiver).c_str(), O_RDWR, 0);
+        if (fd < 0) { return nullptr; }
+        struct stat status;
+        ShmInbox *inbox = nullptr;
+        if (fstat(fd, &status) == 0 && static_cast<size_t>(status.st_size) == ShmInbox::size(this->slots)) {
+            inbox = map(fd, this->slots);
+        }
+        ::close(fd);
+        if (inbox != nullptr && (inbox->magic.load(std::memory_order_acquire) != SHM_MAGIC || inbox->slots != this->slots)) {
+            munmap(inbox, ShmInbox::size(this->slots));
+            inbox = nullptr;
+        }
+        peer.inbox = inbox;
+        return inbox;
+    }
+
+    ssize_t pop_any(char *buffer, size_t capacity) {
+        if (this->has_oversized.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> guard(this->oversized_lock);
+            const std::vector<char> &datagram = this->oversized.front();
+            size_t copied = std::min(datagram.size(), capacity);
+            std::memcpy(buffer, datagram.data(), copied);
+            this->oversized.pop_front();
+            this->has_oversized.store(!this->oversized.empty(), std::memory_order_release);
+            return static_cast<ssize_t>(copied);
+        }
+        for (size_t i = 0; i < this->slots; i++) {
+            size_t slot = (this->next_slot + i) % this->slots;
+            ssize_t length = this->inbox->ring(slot).pop(buffer, capacity);
+            if (length >= 0) {
+                this->next_slot = slot + 1;
+                return length;
+            }
+        }
+        return -1;
+    }
+
+    void forward_udp() {
+        ThreadPlacement::place("shm-udp");
+        char buffer[MAX_UDP_DATAGRAM_SIZE];
+        ShmRing &ring = this->inbox->ring(SHM_UDP_SLOT);
+        while (!this->closed) {
+            ssize_t length = this->udp.receive(buffer, sizeof(buffer));
+            if (length < 0) { break; }
+            if (!ShmRing::fits(static_cast<size_t>(length))) {
+                std::lock_guard<std::mutex> guard(this->oversized_lock);
+                if (this->oversized.size() >= SHM_MAX_OVERSIZED) { continue; }
+                this->oversized.emplace_back(buffer, buffer + length);
+                this->has_oversized.store(true, std::memory_order_release);
+            } else if (!ring.push(buffer, static_cast<size_t>(length))) {
+                continue;
+            }
+            this->inbox->wake();
+        }
+    }
+
+public:
+    static constexpr size_t MAX_UDP_DATAGRAM_SIZE = 65535;
+
+    ShmTransport(const Host &host, const Hosts &hosts) :
+        local_id(host.get_id()), slots(hosts.get_id_bound()), name(inbox_name(host)), udp(host, hosts, false) {
+        // Replace whatever a previous run left behind
+        shm_unlink(this->name.c_str());
+        int fd = shm_open(this->name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(ShmInbox::size(this->slots))) != 0 ||
+            (this->inbox = map(fd, this->slots)) == nullptr) {
+            if (fd >= 0) { ::close(fd); }
+            shm_unlink(this->name.c_str());
+            throw std::runtime_error("Failed to create shared memory inbox " + this->name);
+        }
+        ::close(fd);
+        this->inbox->slots = this->slots;
+        this->inbox->magic.store(SHM_MAGIC, std::memory_order_release);
+
+        this->peers.resize(this->slots);
+        for (auto &peer : this->peers) { peer.reset(new Peer()); }
+        for (const auto &peer : hosts) {
+            this->peers[peer.get_id()]->local = (peer.get_address().ip >> 24) == 127 || peer.get_address().ip == host.get_address().ip;
+        }
+        this->forwarder = std::thread(&ShmTransport::forward_udp, this);
+    }
+
+    ~ShmTransport() override {
+        this->shutdown();
+        this->forwarder.join();
+        for (auto &peer : this->peers) {
+            if (peer->inbox != nullptr) { munmap(peer->inbox, ShmInbox::size(this->slots)); }
+        }
+        munmap(this->inbox, ShmInbox::size(this->slots));
+    }
+
+    ShmTransport(const ShmTransport &) = delete;
+    ShmTransport &operator=(const ShmTransport &) = delete;
+
+    static std::unique_ptr<Transport> create(const Host &host, const Hosts &hosts) {
+        return std::unique_ptr<Transport>(new ShmTransport(host, hosts));
+    }
+
+    void send(const Host &receiver, const char *payload, size_t length) override {
+        Peer &peer = *this->peers[receiver.get_id()];
+        if (peer.local && ShmRing::fits(length)) {
+            std::lock_guard<std::mutex> guard(peer.lock);
+            ShmInbox *inbox = this->open_inbox(receiver, peer);
+            if (inbox != nullptr) {
+                if (inbox->ring(this->local_id).push(payload, length)) { inbox->wake(); }
+                return;
+            }
+        }
+        this->udp.send(receiver, payload, length);
+    }
+
+    ssize_t receive(char *buffer, size_t capacity) override {
+        while (!this->closed) {
+            ssize_t length = this->pop_any(buffer, capacity);
+            if (length >= 0) { return length; }
+
+            // Announce the sleep, then look again: a sender either sees `waiting` or its datagram is found here
+            this->inbox->waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            uint32_t doorbell = this->inbox->doorbell.load(std::memory_order_relaxed);
+            length = this->pop_any(buffer, capacity);
+            if (length < 0 && !this->closed) {
+                timespec timeout{0, SHM_WAIT_TIMEOUT_MS * 1000000L};
+                syscall(SYS_futex, reinterpret_cast<uint32_t *>(&this->inbox->doorbell), FUTEX_WAIT, doorbell, &timeout, nullptr, 0);
+            }
+            this->inbox->waiting.store(0, std::memory_order_relaxed);
+            if (length >= 0) { return length; }
+        }
+        return -1;
+    }
+
+    // Stop receiving and remove the inbox name (peers that mapped it keep their mapping until they exit)
+    void shutdown() override {
+        if (this->closed.exchange(true)) { return; }
+        shm_unlink(this->name.c_str());
+        this->udp.shutdown();
+        this->inbox->waiting.store(1, std::memory_order_relaxed);
+        this->inbox->wake();
+    }
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "latency.hpp"
+#include "thread_placement.hpp"
+#include "transport.hpp"
+
+#define SIM_INBOX_CAPACITY 4096 // Datagrams queued per host before new ones are dropped (like a full socket buffer)
+
+/**
+ * @brief Conditions of a simulated link, in the spirit of `tc netem`
+ */
+struct LinkConditions {
+    double loss{0}; // Probability that a datagram is dropped
+    uint64_t delay_us{0}; // Base one-way delay
+    uint64_t jitter_us{0}; // Delay varies uniformly in [delay - jitter, delay + jitter]
+    double reorder{0}; // Probability that a datagram skips the delay (and overtakes earlier ones)
+};
+
+/**
+ * @brief Per-link conditions and their random draws
+ *
+ * @details Each directed link (from, to) applies its own conditions
+ * (set_link) or the default ones, with its own random generator seeded from
+ * (seed, from, to), so a link's losses and delays only depend on the order of
+ * its own datagrams. Not synchronized.
+ */
+class LinkModel {
+private:
+    struct Link {
+        LinkConditions conditions;
+        std::mt19937_64 rng;
+    };
+
+    LinkConditions default_conditions;
+    uint64_t seed;
+    std::map<std::pair<size_t, size_t>, Link> links;
+
+    Link &link(size_t from, size_t to) {
+        auto it = this->links.find({from, to});
+        if (it == this->links.end()) {
+            it = this->links.emplace(std::make_pair(from, to), Link{this->default_conditions, std::mt19937_64(this->seed ^ (from << 32) ^ to)}).first;
+        }
+        return it->second;
+    }
+
+public:
+    LinkModel(LinkConditions conditions, uint64_t seed) : default_conditions(conditions), seed(seed) {}
+
+    void set_link(size_t from, size_t to, LinkConditions conditions) {
+        this->link(from, to).conditions = conditions;
+    }
+
+    // Delay of the next datagram from -> to in nanoseconds, false if it is lost
+    bool sample(size_t from, size_t to, uint64_t &delay_ns) {
+        Link &link = this->link(from, to);
+        std::uniform_real_distribution<double> unit(0, 1);
+        if (unit(link.rng) < link.conditions.loss) { return false; }
+
+        int64_t delay_us = static_cast<int64_t>(link.conditions.delay_us);
+        if (link.conditions.jitter_us > 0) {
+            auto jitter = static_cast<int64_t>(link.conditions.jitter_us);
+            delay_us += std::uniform_int_distribution<int64_t>(-jitter, jitter)(link.rng);
+        }
+        if (unit(link.rng) < link.conditions.reorder) { delay_us = 0; }
+        delay_ns = static_cast<uint64_t>(std::max<int64_t>(delay_us, 0)) * 1000;
+        return true;
+    }
+};
+
+/**
+ * @brief In-memory datagram network for running many nodes in one process
+ *
+ * @details Install it with Transport::set_factory(network.factory()) before
+ * constructing the nodes, every FairLossLink then sends through the network
+ * instead of UDP. Links behave as a LinkModel decides. Delayed datagrams
+ * wait in a timer queue that a single thread releases into the receivers'
+ * inboxes.
+ */
+class SimulatedNetwork {
+private:
+    struct Datagram {
+        size_t to;
+        std::string bytes;
+    };
+
+    struct Inbox {
+        std::mutex lock;
+        std::condition_variable ready;
+        std::deque<std::string> datagrams;
+        bool closed{false};
+    };
+
+    std::mutex links_lock;
+    LinkModel links;
+    std::vector<std::unique_ptr<Inbox>> inboxes; // Indexed by host ID, created up front
+
+    std::mutex timers_lock;
+    std::condition_variable timers_changed;
+    std::map<std::pair<uint64_t, uint64_t>, Datagram> timers; // By (due time, sending order)
+    uint64_t next_order{0};
+    bool running{true};
+    std::thread timer_thread;
+
+    void deliver(size_t to, std::string bytes) {
+        Inbox &inbox = *this->inboxes[to];
+        std::lock_guard<std::mutex> guard(inbox.lock);
+        if (inbox.closed || inbox.datagrams.size() >= SIM_INBOX_CAPACITY) { return; }
+        inbox.datagrams.push_back(std::move(bytes));
+        inbox.ready.notify_one();
+    }
+
+    void run_timers() {
+        ThreadPlacement::place("sim-timer");
+        std::unique_lock<std::mutex> guard(this->timers_lock);
+        while (this->running) {
+            if (this->timers.empty()) {
+                this->timers_changed.wait(guard);
+                continue;
+            }
+            uint64_t now = monotonic_ns();
+            auto next = this->timers.begin();
+            if (next->first.first > now) {
+                this->timers_changed.wait_for(guard, std::chrono::nanoseconds(next->first.first - now));
+                continue;
+            }
+            Datagram datagram = std::move(next->second);
+            this->timers.erase(next);
+            guard.unlock();
+            this->deliver(datagram.to, std::move(datagram.bytes));
+            guard.lock();
+        }
+    }
+
+public:
+    SimulatedNetwork(const Hosts &hosts, LinkConditions conditions = LinkConditions(), uint64_t seed = 1) :
+        links(conditions, seed), inboxes(hosts.get_id_bound()) {
+        for (auto &inbox : this->inboxes) { inbox.reset(new Inbox()); }
+        this->timer_thread = std::thread(&SimulatedNetwork::run_timers, this);
+    }
+
+    ~SimulatedNetwork() {
+        {
+            std::lock_guard<std::mutex> guard(this->timers_lock);
+            this->running = false;
+        }
+        this->timers_changed.notify_all();
+        this->timer_thread.join();
+    }
+
+    SimulatedNetwork(const SimulatedNetwork &) = delete;
+    SimulatedNetwork &operator=(const SimulatedNetwork &) = delete;
+
+    // Override the conditions of the directed link from -> to
+    void set_link(size_t from, size_t to, LinkConditions conditions) {
+        std::lock_guard<std::mutex> guard(this->links_lock);
+        this->links.set_link(from, to, conditions);
+    }
+
+    void send(size_t from, size_t to, const char *payload, size_t length) {
+        if (to >= this->inboxes.size()) { return; }
+
+        uint64_t delay_ns;
+        {
+            std::lock_guard<std::mutex> guard(this->links_lock);
+            if (!this->links.sample(from, to, delay_ns)) { return; }
+        }
+
+        if (delay_ns == 0) {
+            this->deliver(to, std::string(payload, length));
+            return;
+        }
+        std::lock_guard<std::mutex> guard(this->timers_lock);
+        this->timers.emplace(std::make_pair(monotonic_ns() + delay_ns, this->next_order++), Datagram{to, std::string(payload, length)});
+        this->timers_changed.notify_one();
+    }
+
+    // Block until a datagram for `host_id` arrives, -1 once closed
+    ssize_t receive(size_t host_id, char *buffer, size_t capacity) {
+        Inbox &inbox = *this->inboxes[host_id];
+        std::unique_lock<std::mutex> guard(inbox.lock);
+        inbox.ready.wait(guard, [&]() { return inbox.closed || !inbox.datagrams.empty(); });
+        if (inbox.closed) { return -1; }
+        std::string bytes = std::move(inbox.datagrams.front());
+        inbox.datagrams.pop_front();
+        guard.unlock();
+
+        size_t length = std::min(bytes.size(), capacity);
+        std::memcpy(buffer, bytes.data(), length);
+        return static_cast<ssize_t>(length);
+    }
+
+    void close(size_t host_id) {
+        Inbox &inbox = *this->inboxes[host_id];
+        std::lock_guard<std::mutex> guard(inbox.lock);
+        inbox.closed = true;
+        inbox.ready.notify_all();
+    }
+
+    // Factory for Transport::set_factory, the network must outlive the nodes
+    Transport::Factory factory();
+};
+
+/**
+ * @brief Transport of one host on a SimulatedNetwork
+ */
+class SimulatedTransport : public Transport {
+private:
+    SimulatedNetwork &network;
+    size_t host_id;
+
+public:
+    SimulatedTransport(SimulatedNetwork &network, size_t host_id) : network(network), host_id(host_id) {}
+
+    void send(const Host &receiver, const char *payload, size_t length) override {
+        this->network.send(this->host_id, receiver.get_id(), payload, length);
+    }
+
+    ssize_t receive(char *buffer, size_t capacity) override {
+        return this->network.receive(this->host_id, buffer, capacity);
+    }
+
+    void shutdown() override {
+        this->network.close(this->host_id);
+    }
+};
+
+inline Transport::Factory SimulatedNetwork::factory() {
+    return [this](const Host &host, const Hosts &) {
+        return std::unique_ptr<Transport>(new SimulatedTransport(*this, host.get_id()));
+    };
+}
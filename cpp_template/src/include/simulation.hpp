@@ -0,0 +1,168 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "latency.hpp"
+#include "simulated_network.hpp"
+#include "transport.hpp"
+
+/**
+ * @brief Deterministic discrete-event simulation of a cluster
+ *
+ * @details Time is virtual and there is a single thread: every datagram
+ * delivery and every scheduled task of every node is an event, run in order
+ * of (virtual time, scheduling order). Install it with
+ * Transport::set_factory(simulation.factory()) before constructing the nodes;
+ * their transports are event-driven, so the links start no threads and never
+ * block. Links behave as a LinkModel decides. With the same seed, the same
+ * nodes and the same calls, two runs execute the same events, so counters
+ * such as packets per delivered message are exact rather than sampled.
+ *
+ * Nothing may block inside an event (e.g. LatticeAgreement::propose() beyond
+ * its window). Work that must not run inside a callback (such as proposing
+ * from a decide callback, which runs in the middle of a delivery) goes through
+ * schedule(0, ...).
+ *
+ * Per host, the simulation counts the datagrams and bytes it sends (before
+ * loss) and the wall time spent in its events, to compare how protocols
+ * spread the work over hosts.
+ */
+class Simulation {
+private:
+    struct Node {
+        bool attached{false};
+        std::function<void(const char *, size_t)> receive;
+    };
+
+public:
+    struct HostCost {
+        uint64_t packets_sent{0};
+        uint64_t bytes_sent{0};
+        uint64_t busy_ns{0}; // Wall time in the host's events
+    };
+
+private:
+    LinkModel links;
+    std::vector<Node> nodes; // Indexed by host ID
+    std::vector<HostCost> costs; // Indexed by host ID
+    std::map<std::pair<uint64_t, uint64_t>, std::function<void()>> events; // By (virtual time, scheduling order)
+    uint64_t now_ns{0};
+    uint64_t next_order{0};
+    uint64_t events_run{0};
+
+public:
+    Simulation(const Hosts &hosts, LinkConditions conditions = LinkConditions(), uint64_t seed = 1) :
+        links(conditions, seed), nodes(hosts.get_id_bound()), costs(hosts.get_id_bound()) {}
+
+    Simulation(const Simulation &) = delete;
+    Simulation &operator=(const Simulation &) = delete;
+
+    // Override the conditions of the directed link from -> to
+    void set_link(size_t from, size_t to, LinkConditions conditions) {
+        this->links.set_link(from, to, conditions);
+    }
+
+    // Virtual time in nanoseconds since the start of the simulation
+    uint64_t now() const { return this->now_ns; }
+
+    uint64_t get_events_run() const { return this->events_run; }
+
+    const HostCost &get_cost(size_t host_id) const { return this->costs[host_id]; }
+
+    void schedule(uint64_t delay_ns, std::function<void()> task) {
+        this->events.emplace(std::make_pair(this->now_ns + delay_ns, this->next_order++), std::move(task));
+    }
+
+    // Schedule a task that is dropped if the host detaches first (its node was destroyed)
+    void schedule(size_t host_id, uint64_t delay_ns, std::function<void()> task) {
+        this->schedule(delay_ns, [this, host_id, task = std::move(task)]() {
+            if (!this->nodes[host_id].attached) { return; }
+            uint64_t start_ns = monotonic_ns();
+            task();
+            this->costs[host_id].busy_ns += monotonic_ns() - start_ns;
+        });
+    }
+
+    void attach(size_t host_id, std::function<void(const char *, size_t)> receive) {
+        this->nodes[host_id] = Node{true, std::move(receive)};
+    }
+
+    void detach(size_t host_id) {
+        this->nodes[host_id] = Node();
+    }
+
+    void send(size_t from, size_t to, const char *payload, size_t length) {
+        this->costs[from].packets_sent++;
+        this->costs[from].bytes_sent += length;
+        uint64_t delay_ns;
+        if (to >= this->nodes.size() || !this->links.sample(from, to, delay_ns)) { return; }
+        this->schedule(to, delay_ns, [this, to, bytes = std::string(payload, length)]() {
+            this->nodes[to].receive(bytes.data(), bytes.size());
+        });
+    }
+
+    // Run events until `done` holds (checked after every event), no event is left or virtual time passes `until_ns`
+    bool run(const std::function<bool()> &done, uint64_t until_ns = UINT64_MAX) {
+        while (!this->events.empty() && !done()) {
+            auto next = this->events.begin();
+            if (next->first.first > until_ns) { return false; }
+            this->now_ns = next->first.first;
+            auto task = std::move(next->second);
+            this->events.erase(next);
+            task();
+            this->events_run++;
+        }
+        return done();
+    }
+
+    // Factory for Transport::set_factory, the simulation must outlive the nodes
+    Transport::Factory factory();
+};
+
+/**
+ * @brief Event-driven transport of one host in a Simulation
+ */
+class SimulationTransport : public Transport {
+private:
+    Simulation &simulation;
+    size_t host_id;
+
+public:
+    SimulationTransport(Simulation &simulation, size_t host_id) : simulation(simulation), host_id(host_id) {}
+
+    ~SimulationTransport() override {
+        this->simulation.detach(this->host_id);
+    }
+
+    void send(const Host &receiver, const char *payload, size_t length) override {
+        this->simulation.send(this->host_id, receiver.get_id(), payload, length);
+    }
+
+    ssize_t receive(char *, size_t) override {
+        return -1; // Datagrams arrive through on_receive()
+    }
+
+    void shutdown() override {
+        this->simulation.detach(this->host_id);
+    }
+
+    bool is_event_driven() const override { return true; }
+
+    void on_receive(std::function<void(const char *, size_t)> handler) override {
+        this->simulation.attach(this->host_id, std::move(handler));
+    }
+
+    void schedule(uint64_t delay_ns, std::function<void()> task) override {
+        this->simulation.schedule(this->host_id, delay_ns, std::move(task));
+    }
+};
+
+inline Transport::Factory Simulation::factory() {
+    return [this](const Host &host, const Hosts &) {
+        return std::unique_ptr<Transport>(new SimulationTransport(*this, host.get_id()));
+    };
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "metrics.hpp"
+#include "thread_placement.hpp"
+
+#define STAGE_QUEUE_CAPACITY (1 << 14) // Items queued before push() blocks
+
+/**
+ * @brief Stage of the delivery pipeline
+ *
+ * @details A bounded queue in front of a worker thread that hands everything
+ * queued so far to `handler` in one call, in push order. push() blocks while
+ * the queue is full, so a slow stage holds back the one feeding it (down to
+ * the network thread, where the kernel then drops and PerfectLink
+ * retransmits) instead of buffering without bound. The queue depth is added
+ * to a gauge (summed over the stages sharing it) and every blocked push
+ * counts a stage_stalls, so metrics show where backpressure builds.
+ *
+ * Items pushed before start() wait in the queue. start(false) runs the queued
+ * items and every later push on the caller's thread instead, for event-driven
+ * transports that must not start threads.
+ */
+template <typename T>
+class Stage {
+private:
+    std::string name; // Of the worker thread
+    std::function<void(std::vector<T>)> handler;
+    Gauge depth;
+    size_t capacity;
+    std::deque<T> queue;
+    std::mutex lock;
+    std::condition_variable not_empty, not_full;
+    bool inline_mode{false};
+    bool stopping{false};
+    std::thread worker;
+
+    void run() {
+        ThreadPlacement::place(this->name);
+        std::unique_lock<std::mutex> guard(this->lock);
+        while (true) {
+            this->not_empty.wait(guard, [this]() { return this->stopping || !this->queue.empty(); });
+            if (this->stopping) { return; }
+
+            std::vector<T> items(std::make_move_iterator(this->queue.begin()), std::make_move_iterator(this->queue.end()));
+            this->queue.clear();
+            Metrics::shift(this->depth, -static_cast<int64_t>(items.size()));
+            this->not_full.notify_all();
+
+            guard.unlock();
+            this->handler(std::move(items));
+            guard.lock();
+        }
+    }
+
+public:
+    Stage(std::string name, Gauge depth, std::function<void(std::vector<T>)> handler, size_t capacity = STAGE_QUEUE_CAPACITY) :
+        name(std::move(name)), handler(handler), depth(depth), capacity(capacity) {}
+
+    Stage(const Stage &) = delete;
+    Stage &operator=(const Stage &) = delete;
+
+    ~Stage() {
+        this->stop();
+    }
+
+    void start(bool threaded) {
+        if (threaded) {
+            this->worker = std::thread([this]() { this->run(); });
+            return;
+        }
+
+        std::vector<T> items;
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->inline_mode = true;
+            items.assign(std::make_move_iterator(this->queue.begin()), std::make_move_iterator(this->queue.end()));
+            this->queue.clear();
+            Metrics::shift(this->depth, -static_cast<int64_t>(items.size()));
+        }
+        if (!items.empty()) { this->handler(std::move(items)); }
+    }
+
+    void push(std::vector<T> items) {
+        if (this->inline_mode) {
+            this->handler(std::move(items));
+            return;
+        }
+
+        std::unique_lock<std::mutex> guard(this->lock);
+        if (this->queue.size() >= this->capacity) {
+            Metrics::add(Counter::StageStalls);
+            this->not_full.wait(guard, [this]() { return this->stopping || this->queue.size() < this->capacity; });
+        }
+        if (this->stopping) { return; }
+        for (auto &item : items) { this->queue.push_back(std::move(item)); }
+        Metrics::shift(this->depth, static_cast<int64_t>(items.size()));
+        this->not_empty.notify_one();
+    }
+
+    // Stop the worker after the batch it is handling, queued items are dropped
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->stopping = true;
+            Metrics::shift(this->depth, -static_cast<int64_t>(this->queue.size()));
+            this->queue.clear();
+        }
+        this->not_empty.notify_all();
+        this->not_full.notify_all();
+        if (!this->worker.joinable()) { return; }
+        if (this->worker.get_id() == std::this_thread::get_id()) {
+            this->worker.detach(); // Stopped from its own handler, returns to run() and exits
+        } else {
+            this->worker.join();
+        }
+    }
+};
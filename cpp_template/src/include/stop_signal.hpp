@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cerrno>
+#include <stdexcept>
+
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+/**
+ * @brief Termination signals (SIGINT, SIGTERM) and metrics dump requests
+ * (SIGUSR1) received through a signalfd
+ *
+ * @details Blocks the signals in the calling thread and in every thread it
+ * starts afterwards, so construct it first thing in main(). wait() then
+ * returns a received signal in normal context instead of a signal handler,
+ * so the shutdown code may lock, allocate and flush like any other code.
+ */
+class StopSignal {
+private:
+    sigset_t signals;
+    int fd;
+
+public:
+    StopSignal() {
+        sigemptyset(&this->signals);
+        sigaddset(&this->signals, SIGINT);
+        sigaddset(&this->signals, SIGTERM);
+        sigaddset(&this->signals, SIGUSR1);
+        if (pthread_sigmask(SIG_BLOCK, &this->signals, nullptr) != 0) {
+            throw std::runtime_error("Failed to block termination signals");
+        }
+        this->fd = signalfd(-1, &this->signals, SFD_CLOEXEC);
+        if (this->fd < 0) {
+            throw std::runtime_error("Failed to create signalfd");
+        }
+    }
+
+    ~StopSignal() {
+        ::close(this->fd);
+    }
+
+    // Block until SIGINT, SIGTERM or SIGUSR1 arrives and return it
+    int wait() {
+        struct signalfd_siginfo info;
+        while (true) {
+            ssize_t n = ::read(this->fd, &info, sizeof(info));
+            if (n == static_cast<ssize_t>(sizeof(info))) { break; }
+            if (n < 0 && errno != EINTR) {
+                throw std::runtime_error("Failed to read signalfd");
+            }
+        }
+        return static_cast<int>(info.ssi_signo);
+    }
+
+    // Let a second signal terminate the process right away
+    void restore() {
+        pthread_sigmask(SIG_UNBLOCK, &this->signals, nullptr);
+    }
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <linux/mempolicy.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define PLACEMENT_NAME_LENGTH 15 // Linux thread names are at most 15 characters
+
+/**
+ * @brief Thread names and core placement
+ *
+ * @details Every long-lived thread calls ThreadPlacement::place() first,
+ * which names it (e.g. "pl-recv-3", shown by top -H, perf and gdb) and, once
+ * configure() was given a core list, pins it to the next core of the list
+ * round-robin, so co-located processes stop migrating between cores.
+ *
+ * configure() runs in main() before any thread starts (`--cpus 0-3,8` and/or
+ * `--numa-node 1`). With a NUMA node, the core list is narrowed to that
+ * node's cores and memory allocation prefers the node (set_mempolicy). The
+ * policy and the affinity of the main thread are inherited by every thread
+ * created afterwards, so socket buffers, message payloads and queues are
+ * allocated from the node the threads run on. Without configure(), threads
+ * are only named.
+ */
+class ThreadPlacement {
+private:
+    std::vector<int> cpus; // Cores threads are pinned to, empty to leave them unpinned
+    std::atomic<size_t> next{0};
+
+    ThreadPlacement() = default;
+
+    static std::string read_file(const std::string &path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open " + path);
+        }
+        std::string content;
+        std::getline(file, content);
+        return content;
+    }
+
+public:
+    static ThreadPlacement &instance() {
+        static ThreadPlacement placement;
+        return placement;
+    }
+
+    // Parse a core list such as "0-3,8,10-11" (the format of cpuset and /sys)
+    static std::vector<int> parse_cpu_list(const std::string &list) {
+        std::vector<int> cpus;
+        std::istringstream ranges(list);
+        std::string range;
+        while (std::getline(ranges, range, ',')) {
+            if (range.empty()) { continue; }
+            size_t dash = range.find('-');
+            try {
+                int first = std::stoi(range.substr(0, dash));
+                int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+                if (first < 0 || last < first || last >= CPU_SETSIZE) { throw std::out_of_range(range); }
+                for (int cpu = first; cpu <= last; cpu++) { cpus.push_back(cpu); }
+            } catch (const std::logic_error &) {
+                throw std::runtime_error("Invalid core list `" + list + "`");
+            }
+        }
+        return cpus;
+    }
+
+    // Cores of a NUMA node
+    static std::vector<int> numa_cpus(int node) {
+        return parse_cpu_list(read_file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"));
+    }
+
+    // Restrict the process to `cpu_list` (empty for all cores) on `numa_node` (negative for any)
+    void configure(const std::string &cpu_list, int numa_node) {
+        std::vector<int> cpus = parse_cpu_list(cpu_list);
+        if (numa_node >= 0) {
+            std::vector<int> local = numa_cpus(numa_node);
+            if (cpus.empty()) {
+                cpus = local;
+            } else {
+                std::vector<int> both;
+                for (int cpu : cpus) {
+                    if (std::find(local.begin(), local.end(), cpu) != local.end()) { both.push_back(cpu); }
+                }
+                cpus = both;
+            }
+            if (cpus.empty()) {
+                throw std::runtime_error("No core of `" + cpu_list + "` on NUMA node " + std::to_string(numa_node));
+            }
+
+            unsigned long nodemask[1 + 1024 / (8 * sizeof(unsigned long))] = {};
+            if (static_cast<size_t>(numa_node) >= 1024) {
+                throw std::runtime_error("Invalid NUMA node " + std::to_string(numa_node));
+            }
+            nodemask[static_cast<size_t>(numa_node) / (8 * sizeof(unsigned long))] |= 1UL << (static_cast<size_t>(numa_node) % (8 * sizeof(unsigned long)));
+            if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodemask, 1024 + 1) != 0) {
+                throw std::runtime_error("Failed to prefer memory of NUMA node " + std::to_string(numa_node));
+            }
+        }
+        if (cpus.empty()) { return; }
+
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) { CPU_SET(static_cast<size_t>(cpu), &set); }
+        if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+            throw std::runtime_error("Failed to restrict the process to cores `" + cpu_list + "`");
+        }
+        this->cpus = cpus;
+    }
+
+    const std::vector<int> &get_cpus() const { return this->cpus; }
+
+    // Name the calling thread and pin it to the next configured core, returns the core or -1
+    static int place(const std::string &name) {
+        pthread_setname_np(pthread_self(), name.substr(0, PLACEMENT_NAME_LENGTH).c_str());
+
+        ThreadPlacement &placement = instance();
+        if (placement.cpus.empty()) { return -1; }
+        int cpu = placement.cpus[placement.next++ % placement.cpus.size()];
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(static_cast<size_t>(cpu), &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        return cpu;
+    }
+};
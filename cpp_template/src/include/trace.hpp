@@ -0,0 +1,171 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "latency.hpp"
+
+#define TRACE_RING_CAPACITY (1 << 16) // Events kept per thread, older ones are overwritten
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Span from here to the end of the scope, e.g. TRACE_SPAN("plDeliver", tm.get_seq_number())
+#define TRACE_SPAN(name, arg) TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(name, arg)
+
+// Point in time, e.g. TRACE_INSTANT("decide", round)
+#define TRACE_INSTANT(name, arg) \
+    do { \
+        if (__builtin_expect(Tracer::enabled.load(std::memory_order_relaxed), 0)) { \
+            Tracer::instance().instant(name, arg); \
+        } \
+    } while (0)
+
+/**
+ * @brief Tracer
+ *
+ * @details Opt-in event tracing (`--trace <path>`). Every thread records
+ * spans and instant events into its own ring of TRACE_RING_CAPACITY events,
+ * with no locks or shared writes, keeping the latest events when the ring
+ * wraps. stop() writes all rings as Chrome trace JSON, which
+ * chrome://tracing and ui.perfetto.dev open. While tracing is off, a trace
+ * point is a single branch on a flag.
+ *
+ * Event names must be string literals (only the pointer is stored).
+ */
+class Tracer {
+private:
+    struct Event {
+        const char *name;
+        uint64_t start_ns;
+        uint64_t duration_ns; // UINT64_MAX for instant events
+        uint64_t arg;
+    };
+
+    struct Ring {
+        long tid;
+        std::unique_ptr<Event[]> events{new Event[TRACE_RING_CAPACITY]};
+        std::atomic<size_t> head{0}; // Events ever recorded, written by the owning thread only
+    };
+
+    std::mutex lock; // Guards rings and path
+    std::vector<std::unique_ptr<Ring>> rings;
+    std::string path;
+
+    Tracer() = default;
+
+    Ring &local() {
+        static thread_local Ring *ring = nullptr;
+        if (ring == nullptr) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->rings.emplace_back(new Ring());
+            this->rings.back()->tid = ::syscall(SYS_gettid);
+            ring = this->rings.back().get();
+        }
+        return *ring;
+    }
+
+    void record(const char *name, uint64_t start_ns, uint64_t duration_ns, uint64_t arg) {
+        Ring &ring = this->local();
+        size_t head = ring.head.load(std::memory_order_relaxed);
+        ring.events[head % TRACE_RING_CAPACITY] = Event{name, start_ns, duration_ns, arg};
+        ring.head.store(head + 1, std::memory_order_release);
+    }
+
+    static std::string microseconds(uint64_t ns) {
+        std::string fraction = std::to_string(ns % 1000);
+        return std::to_string(ns / 1000) + "." + std::string(3 - fraction.size(), '0') + fraction;
+    }
+
+public:
+    static inline std::atomic<bool> enabled{false};
+
+    Tracer(const Tracer &) = delete;
+    Tracer &operator=(const Tracer &) = delete;
+
+    static Tracer &instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // Start recording, the trace goes to `file_name` on stop()
+    void start(const std::string &file_name) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        this->path = file_name;
+        enabled = true;
+    }
+
+    void span(const char *name, uint64_t start_ns, uint64_t end_ns, uint64_t arg) {
+        this->record(name, start_ns, end_ns > start_ns ? end_ns - start_ns : 0, arg);
+    }
+
+    void instant(const char *name, uint64_t arg) {
+        this->record(name, monotonic_ns(), UINT64_MAX, arg);
+    }
+
+    // Stop recording and write the Chrome trace (no-op if tracing was never started)
+    void stop() {
+        if (!enabled.exchange(false)) { return; }
+        std::lock_guard<std::mutex> guard(this->lock);
+        std::ofstream file(this->path);
+        if (!file.is_open()) {
+            std::cerr << "Failed to open trace file: " << this->path << "\n";
+            return;
+        }
+
+        long pid = ::getpid();
+        file << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+        file << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":" << pid << ",\"args\":{\"name\":\"da_proc " << pid << "\"}}";
+        for (const auto &ring : this->rings) {
+            size_t head = ring->head.load(std::memory_order_acquire);
+            size_t first = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+            for (size_t i = first; i < head; i++) {
+                const Event &event = ring->events[i % TRACE_RING_CAPACITY];
+                file << ",\n{\"name\":\"" << event.name << "\",\"pid\":" << pid << ",\"tid\":" << ring->tid
+                     << ",\"ts\":" << microseconds(event.start_ns);
+                if (event.duration_ns == UINT64_MAX) {
+                    file << ",\"ph\":\"i\",\"s\":\"t\"";
+                } else {
+                    file << ",\"ph\":\"X\",\"dur\":" << microseconds(event.duration_ns);
+                }
+                file << ",\"args\":{\"v\":" << event.arg << "}}";
+            }
+        }
+        file << "\n]}\n";
+    }
+};
+
+/**
+ * @brief Scoped trace span, see TRACE_SPAN
+ */
+class TraceSpan {
+private:
+    const char *name;
+    uint64_t arg;
+    uint64_t start_ns{0}; // 0 while tracing is off
+
+public:
+    TraceSpan(const char *name, uint64_t arg) : name(name), arg(arg) {
+        if (__builtin_expect(Tracer::enabled.load(std::memory_order_relaxed), 0)) {
+            this->start_ns = monotonic_ns();
+        }
+    }
+
+    ~TraceSpan() {
+        if (__builtin_expect(this->start_ns != 0, 0) && Tracer::enabled.load(std::memory_order_relaxed)) {
+            Tracer::instance().span(this->name, this->start_ns, monotonic_ns(), this->arg);
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
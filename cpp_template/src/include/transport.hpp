@@ -0,0 +1,252 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+
+#include <cerrno>
+
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "hosts.hpp"
+#include "metrics.hpp"
+
+#define UDP_DEFAULT_SOCKET_BUFFER (8 << 20) // Bytes requested for SO_RCVBUF and SO_SNDBUF, 8 MiB
+#define UDP_MAX_PAYLOAD 65507 // Largest UDP payload over IPv4, also the limit of a segmented send
+#define UDP_MAX_SEGMENTS 64 // Segments per segmented send (the kernel's UDP_MAX_SEGMENTS)
+
+/**
+ * @brief Datagram transport under FairLossLink
+ *
+ * @details Sends datagrams to hosts and blocks until one arrives. Delivery
+ * may lose, delay, duplicate or reorder datagrams, which is all FairLossLink
+ * promises anyway. Transport::create() builds the transport for a host: UDP by
+ * default, or whatever set_factory() installed (e.g. a SimulatedNetwork),
+ * which must happen before the first link is constructed.
+ *
+ * An event-driven transport (a Simulation) has no blocking receive(): it
+ * hands datagrams to the on_receive() handler and runs schedule()d tasks on
+ * its own scheduler, and the layers above then start no threads.
+ */
+class Transport {
+public:
+    using Factory = std::function<std::unique_ptr<Transport>(const Host &, const Hosts &)>;
+
+    virtual ~Transport() = default;
+
+    virtual void send(const Host &receiver, const char *payload, size_t length) = 0;
+
+    // Datagrams send_segments() can carry at once, 1 if it just calls send() per segment
+    virtual size_t max_segments() const { return 1; }
+
+    // Send `payload` as datagrams of `segment_size` bytes (the last one may be shorter)
+    virtual void send_segments(const Host &receiver, const char *payload, size_t length, size_t segment_size) {
+        for (size_t offset = 0; offset < length; offset += segment_size) {
+            this->send(receiver, payload + offset, std::min(segment_size, length - offset));
+        }
+    }
+
+    // Block until a datagram arrives, returns its length or -1 once shut down
+    virtual ssize_t receive(char *buffer, size_t capacity) = 0;
+
+    // Stop receiving, also wakes up a blocked receive()
+    virtual void shutdown() = 0;
+
+    virtual bool is_event_driven() const { return false; }
+
+    // Event-driven only: deliver every datagram to `handler`
+    virtual void on_receive(std::function<void(const char *, size_t)>) {
+        throw std::runtime_error("Transport is not event-driven");
+    }
+
+    // Event-driven only: run `task` after `delay_ns` of (simulated) time
+    virtual void schedule(uint64_t, std::function<void()>) {
+        throw std::runtime_error("Transport is not event-driven");
+    }
+
+    static void set_factory(Factory factory) {
+        Transport::factory() = std::move(factory);
+    }
+
+    static std::unique_ptr<Transport> create(const Host &host, const Hosts &hosts);
+
+private:
+    static Factory &factory() {
+        static Factory factory;
+        return factory;
+    }
+};
+
+/**
+ * @brief UDP socket bound to the host's address
+ *
+ * @details Socket buffers are enlarged to set_socket_buffer() bytes (beyond
+ * net.core.rmem_max/wmem_max with CAP_NET_ADMIN, up to them otherwise), so a
+ * burst waits in the kernel instead of being dropped. The kernel still drops
+ * datagrams that arrive on a full receive buffer; SO_RXQ_OVFL reports its
+ * running count with every datagram, and receive() adds the increase to the
+ * socket_drops counter.
+ *
+ * With segmentation (set_segmentation(true)), send_segments() hands the
+ * kernel one buffer of up to UDP_MAX_SEGMENTS datagrams (UDP_SEGMENT, GSO),
+ * which it splits as late as possible (in the NIC with hardware offload), and
+ * the socket accepts coalesced datagrams (UDP_GRO): receive() may return
+ * several consecutive datagrams of one sender in one buffer, so a receiver
+ * must parse them without relying on datagram boundaries (see SendBuffer).
+ * If the kernel or the route rejects UDP_SEGMENT, the socket falls back to
+ * one send() per segment.
+ */
+class UdpTransport : public Transport {
+private:
+    const Hosts &hosts;
+    int sockfd;
+    uint32_t drops{0}; // Last SO_RXQ_OVFL count seen
+    std::atomic<bool> segmentation{false}; // UDP_SEGMENT and UDP_GRO enabled
+
+    static bool &segmentation_enabled() {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    static size_t &socket_buffer() {
+        static size_t bytes = UDP_DEFAULT_SOCKET_BUFFER;
+        return bytes;
+    }
+
+    // Try the privileged option first, it ignores the sysctl limit
+    void set_buffer(int force_option, int option, int bytes) {
+        if (setsockopt(this->sockfd, SOL_SOCKET, force_option, &bytes, sizeof(bytes)) != 0) {
+            setsockopt(this->sockfd, SOL_SOCKET, option, &bytes, sizeof(bytes));
+        }
+    }
+
+public:
+    // `coalesce`: accept coalesced datagrams, only for receivers that parse them (see the class comment)
+    UdpTransport(const Host &host, const Hosts &hosts, bool coalesce = UdpTransport::segmentation_enabled()) : hosts(hosts) {
+        // Create socket
+        this->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (this->sockfd < 0) {
+            throw std::runtime_error("Failed to create socket at " + host.get_address().to_string());
+        }
+
+        // Bind socket
+        auto sock_addr = host.get_address().to_sockaddr();
+        if (bind(this->sockfd, reinterpret_cast<sockaddr *>(&sock_addr), sizeof(sock_addr)) == -1) {
+            ::close(this->sockfd);
+            throw std::runtime_error("Failed to bind socket at " + host.get_address().to_string());
+        }
+
+        // Enlarge socket buffers (0 keeps the system defaults), count kernel drops
+        int bytes = static_cast<int>(std::min<size_t>(UdpTransport::socket_buffer(), INT32_MAX / 2));
+        if (bytes > 0) {
+            this->set_buffer(SO_RCVBUFFORCE, SO_RCVBUF, bytes);
+            this->set_buffer(SO_SNDBUFFORCE, SO_SNDBUF, bytes);
+        }
+        int enable = 1;
+        setsockopt(this->sockfd, SOL_SOCKET, SO_RXQ_OVFL, &enable, sizeof(enable));
+
+        // Segmented sends and coalesced receives, where the kernel supports them (Linux 5.0+)
+        if (coalesce && setsockopt(this->sockfd, SOL_UDP, UDP_GRO, &enable, sizeof(enable)) == 0) {
+            this->segmentation = true;
+        }
+    }
+
+    // Socket buffer size of transports created from now on, 0 for the system defaults
+    static void set_socket_buffer(size_t bytes) {
+        UdpTransport::socket_buffer() = bytes;
+    }
+
+    // Whether transports created from now on use UDP_SEGMENT and UDP_GRO
+    static void set_segmentation(bool enable) {
+        UdpTransport::segmentation_enabled() = enable;
+    }
+
+    ~UdpTransport() override {
+        ::close(this->sockfd);
+    }
+
+    UdpTransport(const UdpTransport &) = delete;
+    UdpTransport &operator=(const UdpTransport &) = delete;
+
+    void send(const Host &receiver, const char *payload, size_t length) override {
+        const sockaddr_in &address = this->hosts.get_sockaddr(receiver.get_id());
+        sendto(this->sockfd, payload, length, 0, reinterpret_cast<const sockaddr *>(&address), sizeof(address));
+    }
+
+    size_t max_segments() const override {
+        return this->segmentation ? UDP_MAX_SEGMENTS : 1;
+    }
+
+    void send_segments(const Host &receiver, const char *payload, size_t length, size_t segment_size) override {
+        if (!this->segmentation || length <= segment_size) {
+            Transport::send_segments(receiver, payload, length, segment_size);
+            return;
+        }
+
+        sockaddr_in address = this->hosts.get_sockaddr(receiver.get_id());
+        iovec data{const_cast<char *>(payload), length};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+        msghdr header{};
+        header.msg_name = &address;
+        header.msg_namelen = sizeof(address);
+        header.msg_iov = &data;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        cmsghdr *message = CMSG_FIRSTHDR(&header);
+        message->cmsg_level = SOL_UDP;
+        message->cmsg_type = UDP_SEGMENT;
+        message->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        auto size = static_cast<uint16_t>(segment_size);
+        std::memcpy(CMSG_DATA(message), &size, sizeof(size));
+
+        if (sendmsg(this->sockfd, &header, 0) < 0 && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)) {
+            // No GSO on this route (e.g. no checksum offload), segment in user space from now on
+            this->segmentation = false;
+            Transport::send_segments(receiver, payload, length, segment_size);
+        }
+    }
+
+    ssize_t receive(char *buffer, size_t capacity) override {
+        sockaddr_in source;
+        iovec data{buffer, capacity};
+        alignas(cmsghdr) char control[CMSG_SPACE(sizeof(uint32_t)) + CMSG_SPACE(sizeof(int))]; // SO_RXQ_OVFL, UDP_GRO
+        msghdr header{};
+        header.msg_name = &source;
+        header.msg_namelen = sizeof(source);
+        header.msg_iov = &data;
+        header.msg_iovlen = 1;
+        header.msg_control = control;
+        header.msg_controllen = sizeof(control);
+
+        ssize_t length = recvmsg(this->sockfd, &header, 0);
+        if (length < 0) { return length; }
+        for (cmsghdr *message = CMSG_FIRSTHDR(&header); message != nullptr; message = CMSG_NXTHDR(&header, message)) {
+            if (message->cmsg_level != SOL_SOCKET || message->cmsg_type != SO_RXQ_OVFL) { continue; }
+            uint32_t drops;
+            std::memcpy(&drops, CMSG_DATA(message), sizeof(drops));
+            if (drops != this->drops) {
+                Metrics::add(Counter::SocketDrops, drops - this->drops);
+                this->drops = drops;
+            }
+        }
+        return length;
+    }
+
+    void shutdown() override {
+        ::shutdown(this->sockfd, SHUT_RD);
+    }
+};
+
+inline std::unique_ptr<Transport> Transport::create(const Host &host, const Hosts &hosts) {
+    if (Transport::factory()) { return Transport::factory()(host, hosts); }
+    return std::unique_ptr<Transport>(new UdpTransport(host, hosts));
+}
@@ -1,9 +1,8 @@
 #pragma once
 
-#include <unordered_set>
+#include <cstddef>
 
 // Milestone 3: Lattice Agreement
 typedef size_t Round;
 typedef size_t ProposalNumber;
 typedef int ProposalValue;
-typedef std::unordered_set<ProposalValue> Proposal;
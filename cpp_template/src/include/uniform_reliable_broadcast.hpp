@@ -1,12 +1,12 @@
 #pragma once
 
-#include <set>
-#include <map>
 #include <iostream>
 #include <functional>
 
 #include "hosts.hpp"
-#include "message_set.hpp"
+#include "ack_table.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 #include "best_effort_broadcast.hpp"
 
 /**
@@ -22,75 +22,61 @@
  *   m must have been broadcast by s.
  * - (URB4: Uniform Agreement) If m is delivered by some process (whether correct
  *   or faulty), then m is eventually delivered by every correct process.
+ *
+ * BEB hands over the messages of each received datagram together, and all of
+ * them go through the AckTable under one lock.
  */
 class UniformReliableBroadcast {
 private:
     Host host;
-    Hosts hosts;
-    MessageSet pending_messages;
-    MessageSet delivered_messages;
-    MessagePairSet acked_messages;
+    AckTable acks;
     std::function<void(BroadcastMessage)> handler;
+    std::atomic<size_t> next_seq_number{SEQ_NUM_INIT}; // Per instance, so nodes sharing a process number independently
     BestEffortBroadcast beb;
 
-    bool can_deliver(const BroadcastMessage &bm) {
-        size_t min_correct_hosts = static_cast<size_t>(this->hosts.get_host_count() / 2) + 1;
-        size_t source_id = bm.get_source_id();
-        size_t count = 0;
-        for (auto host: this->hosts.get_hosts()) {
-            size_t sender_id = host.get_id();
-            if (this->acked_messages.contains(source_id, sender_id, bm.get_seq_number())) {
-                count++;
-            }
+    // A BEB batch: every message is an ack by its sender, relay the new ones, deliver those a majority acked
+    void deliver(std::vector<TransportMessage> tms) {
+        std::vector<AckTable::Event> events;
+        events.reserve(tms.size());
+        for (const auto &tm : tms) {
+            events.push_back(AckTable::Event{tm.get_sender().get_id(), BroadcastMessage(tm.get_payload())});
         }
-        return count >= min_correct_hosts;
-    }
-
-    void deliver(BroadcastMessage bm, Host sender) {
-        // std::cout << "urbReceive: " << bm << std::endl;
 
-        // Add broadcast message to ACK set (I know that the sender has seen this broadcast message from source)
-        size_t sender_id = sender.get_id();
-        size_t source_id = bm.get_source_id();
-        size_t message_id = bm.get_seq_number();
-        this->acked_messages.insert(source_id, sender_id, message_id);
+        std::vector<BroadcastMessage> relays, deliveries;
+        this->acks.apply(events, relays, deliveries);
 
-        // If not pending, then add to pending set and relay
-        bool pending = this->pending_messages.contains(source_id, message_id);
-        if (!pending) {
+        for (auto &bm : relays) {
             // std::cout << "urbRelay: " << bm << std::endl;
-            this->pending_messages.insert(source_id, bm.get_seq_number());
+            Metrics::add(Counter::UrbRelays);
             this->beb.broadcast(bm);
-            return;
-        } 
-
-        // Else, check majority if message can be delivered
-        bool can_deliver = this->can_deliver(bm);
-        bool already_delivered = this->delivered_messages.contains(source_id, bm.get_seq_number());
-        if (can_deliver && !already_delivered) {
+        }
+        for (auto &bm : deliveries) {
             // std::cout << "urbDeliver: " << bm << std::endl;
-            this->delivered_messages.insert(source_id, bm.get_seq_number());
+            Metrics::add(Counter::UrbDelivered);
+            if constexpr (LATENCY_TRACKING) { Metrics::record_since(Latency::UrbDelivery, bm.get_timestamp()); }
+            TRACE_SPAN("urbDeliver", bm.get_source_id());
             this->handler(std::move(bm));
         }
     }
 
 public:
-    UniformReliableBroadcast(Host local_host, Hosts hosts, std::function<void(BroadcastMessage)> handler): 
-        host(local_host), hosts(hosts), pending_messages(hosts), delivered_messages(hosts), acked_messages(hosts), handler(handler),
-        beb(local_host, hosts, [this](TransportMessage tm) { 
-            this->deliver(BroadcastMessage(tm.get_payload()), tm.get_sender());
-        }) {
+    UniformReliableBroadcast(Host local_host, const Hosts &hosts, std::function<void(BroadcastMessage)> handler, BebMode beb_mode = BebMode::Direct): 
+        host(local_host), acks(hosts), handler(handler),
+        beb(local_host, hosts, [this](std::vector<TransportMessage> tms) { this->deliver(std::move(tms)); }, beb_mode) {
         // std::cout << "Setting up URB at " << local_host.get_address().to_string() << std::endl;
     }
 
     void broadcast(Message &m) {
         size_t source_id = (this->host.get_id());
-        auto bm = BroadcastMessage(m, source_id);
-        this->pending_messages.insert(source_id, bm.get_seq_number());
+        auto bm = BroadcastMessage(m, this->next_seq_number++, source_id);
+        this->acks.broadcast(bm);
         // std::cout << "urbBroadcast: " << bm << std::endl;
+        Metrics::add(Counter::UrbBroadcasts);
         this->beb.broadcast(bm);
     }
 
+    bool is_event_driven() const { return this->beb.is_event_driven(); }
+
     void shutdown() {
         this->beb.shutdown();
     }
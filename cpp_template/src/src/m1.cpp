@@ -28,24 +28,23 @@
 #include "parser.hpp"
 #include "hosts.hpp"
 #include "config.hpp"
+#include "log.hpp"
 #include "output.hpp"
+#include "metrics.hpp"
+#include "stop_signal.hpp"
+#include "trace.hpp"
+#include "thread_placement.hpp"
+#include "shm_transport.hpp"
 #include "message.hpp"
 #include "perfect_link.hpp"
 
 // Globals
-static std::atomic<bool> should_stop(false);
 static PerfectLink *global_pl = nullptr;
 static OutputFile *global_output_file = nullptr;
 
+// Runs on the main thread once SIGINT/SIGTERM arrived (see StopSignal)
 static void stop(int)
 {
-  // Reset signal handlers to default
-  signal(SIGTERM, SIG_DFL);
-  signal(SIGINT, SIG_DFL);
-
-  // Set the stop flag
-  should_stop = true;
-
   // Immediately stop network packet processing
   if (global_pl != nullptr)
   {
@@ -53,30 +52,32 @@ static void stop(int)
     global_pl->shutdown();
   }
 
+  // Write every queued line, then leave without running destructors (workers may still block)
   if (global_output_file != nullptr)
   {
     std::cout << "Flushing output.\n";
-    global_output_file->flush();
+    global_output_file->close();
   }
-
-  // Exit directly from signal handler
-  exit(0);
+  Metrics::instance().stop();
+  Tracer::instance().stop();
+  Logger::flush();
+  std::cout.flush();
+  _exit(0);
 }
 
 static void plSend(StringMessage sm) {
-  global_output_file->write("b " + sm.get_message() + "\n");
+  global_output_file->broadcast(std::stoull(sm.get_message()));
 }
 
 static void plDeliver(TransportMessage tm) {
   auto sender_id = tm.get_sender().get_id();
   auto message = StringMessage(tm.get_payload()).get_message();
-  global_output_file->write("d " + std::to_string(sender_id) + " " + message + "\n");
+  global_output_file->deliver(sender_id, std::stoull(message));
 }
 
 int main(int argc, char **argv) {
-  // Set up signal handlers
-  signal(SIGTERM, stop);
-  signal(SIGINT, stop);
+  // Receive SIGINT/SIGTERM on a signalfd, before any thread is started
+  StopSignal stop_signal;
 
   // Whether a config file is required
   bool requireConfig = true;
@@ -91,11 +92,19 @@ int main(int argc, char **argv) {
 
   std::cout << "Doing some initialization...\n\n";
 
+  // Pin threads to cores (`--cpus 0-3,8`), of a NUMA node whose memory is preferred (`--numa-node 1`)
+  std::string cpus = parser.option("cpus", std::string());
+  std::string numa_node = parser.option("numa-node", std::string());
+  if (!cpus.empty() || !numa_node.empty()) {
+    ThreadPlacement::instance().configure(cpus, numa_node.empty() ? -1 : static_cast<int>(parser.option("numa-node", size_t{0})));
+    std::cout << "Pinning threads to " << ThreadPlacement::instance().get_cpus().size() << " cores\n\n";
+  }
+
   // Load the hosts file
   Hosts hosts(parser.hostsPath());
   std::string result;
   result = "Loaded hosts (";
-  for (auto host : hosts.get_hosts()) {
+  for (const auto &host : hosts) {
     result += host.to_string() + ", ";
   }
   result.replace(result.end() - 2, result.end(), ")");
@@ -118,6 +127,39 @@ int main(int argc, char **argv) {
   global_output_file = &output_file;
   std::cout << "Opened output file at " << parser.outputPath() << "\n\n";
 
+  // Dump metrics to a file every interval (`--metrics path [--metrics-interval ms]`), SIGUSR1 dumps right away
+  std::string metrics_path = parser.option("metrics", std::string());
+  if (!metrics_path.empty()) {
+    Metrics::instance().start(metrics_path, parser.option("metrics-interval", METRICS_DEFAULT_INTERVAL_MS));
+    std::cout << "Dumping metrics to " << metrics_path << "\n\n";
+  }
+
+  // Record a Chrome trace, written on exit (`--trace path`)
+  std::string trace_path = parser.option("trace", std::string());
+  if (!trace_path.empty()) {
+    Tracer::instance().start(trace_path);
+    std::cout << "Tracing to " << trace_path << "\n\n";
+  }
+
+  // Reach peers on this machine through shared memory rings, UDP otherwise (`--transport shm`)
+  if (parser.option("transport", std::string("udp")) == "shm") {
+    Transport::set_factory(ShmTransport::create);
+    std::cout << "Using shared memory for local peers\n\n";
+  }
+
+  // Socket buffer size (`--socket-buffer bytes`, 0 for the system default), pace sends to each host unless `--pacing off`
+  UdpTransport::set_socket_buffer(parser.option("socket-buffer", static_cast<size_t>(UDP_DEFAULT_SOCKET_BUFFER)));
+  if (parser.option("pacing", std::string("on")) == "off") {
+    Pacer::set_enabled(false);
+    std::cout << "Sending without pacing\n\n";
+  }
+
+  // Hand the kernel up to 64 KB of datagrams per host at once and accept coalesced ones (`--gso on`)
+  if (parser.option("gso", std::string("off")) == "on") {
+    UdpTransport::set_segmentation(true);
+    std::cout << "Using UDP segmentation offload\n\n";
+  }
+
   // Instantiate perfect link
   PerfectLink pl(local_host, hosts, plDeliver);
   global_pl = &pl;
@@ -126,19 +168,26 @@ int main(int argc, char **argv) {
   std::cout << "Timestamp: " << std::time(nullptr) * 1000 << "\n\n";
   std::cout << "Broadcasting and delivering messages...\n\n";
 
-  // Send messages
-  if (local_host.get_id() != receiver_host.get_id()) {
-    for (int i=1; i<=config.get_message_count(); i++) {
-      StringMessage sm(std::to_string(i));
-      plSend(sm);
-      pl.send(sm, receiver_host);
+  // Send messages on a worker thread, main waits for the stop signal
+  std::thread sender([&]() {
+    ThreadPlacement::place("sender");
+    if (local_host.get_id() != receiver_host.get_id()) {
+      for (int i=1; i<=config.get_message_count(); i++) {
+        StringMessage sm(std::to_string(i));
+        plSend(sm);
+        pl.send(sm, receiver_host);
+      }
     }
-  }
+  });
+  sender.detach();
 
-  // Infinite loop to keep the program running
-  while (!should_stop) {
-    std::this_thread::sleep_for(std::chrono::hours(1));
+  // Wait for SIGINT/SIGTERM (dumping metrics on SIGUSR1), a second one terminates right away
+  int signum;
+  while ((signum = stop_signal.wait()) == SIGUSR1) {
+    Metrics::instance().dump();
   }
+  stop_signal.restore();
+  stop(signum);
 
   return 0;
 }
@@ -28,24 +28,23 @@
 #include "parser.hpp"
 #include "hosts.hpp"
 #include "config.hpp"
+#include "log.hpp"
 #include "output.hpp"
+#include "metrics.hpp"
+#include "stop_signal.hpp"
+#include "trace.hpp"
+#include "thread_placement.hpp"
+#include "shm_transport.hpp"
 #include "message.hpp"
 #include "fifo_uniform_reliable_broadcast.hpp"
 
 // Globals
-static std::atomic<bool> should_stop(false);
 static FIFOUniformReliableBroadcast *global_frb = nullptr;
 static OutputFile *global_output_file = nullptr;
 
+// Runs on the main thread once SIGINT/SIGTERM arrived (see StopSignal)
 static void stop(int)
 {
-  // Reset signal handlers to default
-  signal(SIGTERM, SIG_DFL);
-  signal(SIGINT, SIG_DFL);
-
-  // Set the stop flag
-  should_stop = true;
-
   // Immediately stop network packet processing
   if (global_frb != nullptr)
   {
@@ -53,33 +52,34 @@ static void stop(int)
     global_frb->shutdown();
   }
 
+  // Write every queued line, then leave without running destructors (workers may still block)
   if (global_output_file != nullptr)
   {
     std::cout << "Flushing output.\n";
-    global_output_file->flush();
+    global_output_file->close();
   }
-
-  // Exit directly from signal handler
-  exit(0);
+  Metrics::instance().stop();
+  Tracer::instance().stop();
+  Logger::flush();
+  std::cout.flush();
+  _exit(0);
 }
 
 static void frbBroadcast(StringMessage m)
 {
-  // std::cout << "b " << msg.get_message() << std::endl;
-  global_output_file->write("b " + m.get_message() + "\n");
+  global_output_file->broadcast(std::stoull(m.get_message()));
 }
 
 static void frbDeliver(BroadcastMessage bm)
 {
   StringMessage sm(bm.get_payload());
   std::string message = sm.get_message();
-  global_output_file->write("d " + std::to_string(bm.get_source_id()) + " " + message + "\n");
+  global_output_file->deliver(bm.get_source_id(), std::stoull(message));
 }
 
 int main(int argc, char **argv) {
-  // Set up signal handlers
-  signal(SIGTERM, stop);
-  signal(SIGINT, stop);
+  // Receive SIGINT/SIGTERM on a signalfd, before any thread is started
+  StopSignal stop_signal;
 
   // Whether a config file is required
   bool requireConfig = true;
@@ -94,11 +94,19 @@ int main(int argc, char **argv) {
 
   std::cout << "Doing some initialization...\n\n";
 
+  // Pin threads to cores (`--cpus 0-3,8`), of a NUMA node whose memory is preferred (`--numa-node 1`)
+  std::string cpus = parser.option("cpus", std::string());
+  std::string numa_node = parser.option("numa-node", std::string());
+  if (!cpus.empty() || !numa_node.empty()) {
+    ThreadPlacement::instance().configure(cpus, numa_node.empty() ? -1 : static_cast<int>(parser.option("numa-node", size_t{0})));
+    std::cout << "Pinning threads to " << ThreadPlacement::instance().get_cpus().size() << " cores\n\n";
+  }
+
   // Load the hosts file
   Hosts hosts(parser.hostsPath());
   std::string result;
   result = "Loaded hosts (";
-  for (auto host : hosts.get_hosts()) {
+  for (const auto &host : hosts) {
     result += host.to_string() + ", ";
   }
   result.replace(result.end() - 2, result.end(), ")");
@@ -118,24 +126,72 @@ int main(int argc, char **argv) {
   global_output_file = &output_file;
   std::cout << "Opened output file at " << parser.outputPath() << "\n\n";
 
+  // Dump metrics to a file every interval (`--metrics path [--metrics-interval ms]`), SIGUSR1 dumps right away
+  std::string metrics_path = parser.option("metrics", std::string());
+  if (!metrics_path.empty()) {
+    Metrics::instance().start(metrics_path, parser.option("metrics-interval", METRICS_DEFAULT_INTERVAL_MS));
+    std::cout << "Dumping metrics to " << metrics_path << "\n\n";
+  }
+
+  // Record a Chrome trace, written on exit (`--trace path`)
+  std::string trace_path = parser.option("trace", std::string());
+  if (!trace_path.empty()) {
+    Tracer::instance().start(trace_path);
+    std::cout << "Tracing to " << trace_path << "\n\n";
+  }
+
+  // Reach peers on this machine through shared memory rings, UDP otherwise (`--transport shm`)
+  if (parser.option("transport", std::string("udp")) == "shm") {
+    Transport::set_factory(ShmTransport::create);
+    std::cout << "Using shared memory for local peers\n\n";
+  }
+
+  // Socket buffer size (`--socket-buffer bytes`, 0 for the system default), pace sends to each host unless `--pacing off`
+  UdpTransport::set_socket_buffer(parser.option("socket-buffer", static_cast<size_t>(UDP_DEFAULT_SOCKET_BUFFER)));
+  if (parser.option("pacing", std::string("on")) == "off") {
+    Pacer::set_enabled(false);
+    std::cout << "Sending without pacing\n\n";
+  }
+
+  // Hand the kernel up to 64 KB of datagrams per host at once and accept coalesced ones (`--gso on`)
+  if (parser.option("gso", std::string("off")) == "on") {
+    UdpTransport::set_segmentation(true);
+    std::cout << "Using UDP segmentation offload\n\n";
+  }
+
+  // Relay broadcasts along a spanning tree instead of sending to every host (`--beb tree`)
+  BebMode beb_mode = BebMode::Direct;
+  if (parser.option("beb", std::string("direct")) == "tree") {
+    beb_mode = BebMode::Tree;
+    std::cout << "Broadcasting along a tree (fanout " << BEB_DEFAULT_FANOUT << ")\n\n";
+  }
+
   // Instantiate lattice agreement
-  FIFOUniformReliableBroadcast frb(local_host, hosts, frbDeliver);
+  FIFOUniformReliableBroadcast frb(local_host, hosts, frbDeliver, beb_mode);
   global_frb = &frb;
 
   // Start broadcasting and delivering messages
   std::cout << "Timestamp: " << std::time(nullptr) * 1000 << "\n\n";
   std::cout << "Broadcasting and delivering messages...\n\n";
 
-  for (int i = 1; i <= config.get_message_count(); i++) {
-    StringMessage m(std::to_string(i));
-    frb.broadcast(m);
-    frbBroadcast(m);
-  }
-
-  // Infinite loop to keep the program running
-  while (!should_stop) {
-    std::this_thread::sleep_for(std::chrono::hours(1));
+  // Broadcast on a worker thread, main waits for the stop signal
+  std::thread broadcaster([&]() {
+    ThreadPlacement::place("broadcaster");
+    for (int i = 1; i <= config.get_message_count(); i++) {
+      StringMessage m(std::to_string(i));
+      frbBroadcast(m); // Log first, a delivery of m may be logged before broadcast() returns
+      frb.broadcast(m);
+    }
+  });
+  broadcaster.detach();
+
+  // Wait for SIGINT/SIGTERM (dumping metrics on SIGUSR1), a second one terminates right away
+  int signum;
+  while ((signum = stop_signal.wait()) == SIGUSR1) {
+    Metrics::instance().dump();
   }
+  stop_signal.restore();
+  stop(signum);
 
   return 0;
 }
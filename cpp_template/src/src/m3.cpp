@@ -26,27 +26,27 @@
 
 // Project headers
 #include "types.hpp"
+#include "proposal.hpp"
 #include "parser.hpp"
 #include "hosts.hpp"
 #include "config.hpp"
+#include "log.hpp"
 #include "output.hpp"
+#include "metrics.hpp"
+#include "stop_signal.hpp"
+#include "trace.hpp"
+#include "thread_placement.hpp"
+#include "shm_transport.hpp"
 #include "message.hpp"
 #include "lattice_agreement.hpp"
 
 // Globals
-static std::atomic<bool> should_stop(false);
 static LatticeAgreement *global_la = nullptr;
 static OutputFile *global_output_file = nullptr;
 
+// Runs on the main thread once SIGINT/SIGTERM arrived (see StopSignal)
 static void stop(int)
 {
-  // Reset signal handlers to default
-  signal(SIGTERM, SIG_DFL);
-  signal(SIGINT, SIG_DFL);
-
-  // Set the stop flag
-  should_stop = true;
-
   // Immediately stop network packet processing
   if (global_la != nullptr)
   {
@@ -54,30 +54,26 @@ static void stop(int)
     global_la->shutdown();
   }
 
+  // Write every queued line, then leave without running destructors (workers may still block)
   if (global_output_file != nullptr)
   {
     std::cout << "Flushing output.\n";
-    global_output_file->flush();
+    global_output_file->close();
   }
-
-  // Exit directly from signal handler
-  exit(0);
+  Metrics::instance().stop();
+  Tracer::instance().stop();
+  Logger::flush();
+  std::cout.flush();
+  _exit(0);
 }
 
 static void laDecide(Proposal proposal) {
-  std::string message;
-  for (auto value: proposal) {
-      message += std::to_string(value) + " ";
-  }
-  std::cout << "laDecide: " << message << std::endl;
-  message += "\n";
-  global_output_file->write(message);
+  global_output_file->decide(std::move(proposal));
 }
 
 int main(int argc, char **argv) {
-  // Set up signal handlers
-  signal(SIGTERM, stop);
-  signal(SIGINT, stop);
+  // Receive SIGINT/SIGTERM on a signalfd, before any thread is started
+  StopSignal stop_signal;
 
   // Whether a config file is required
   bool requireConfig = true;
@@ -92,11 +88,19 @@ int main(int argc, char **argv) {
 
   std::cout << "Doing some initialization...\n\n";
 
+  // Pin threads to cores (`--cpus 0-3,8`), of a NUMA node whose memory is preferred (`--numa-node 1`)
+  std::string cpus = parser.option("cpus", std::string());
+  std::string numa_node = parser.option("numa-node", std::string());
+  if (!cpus.empty() || !numa_node.empty()) {
+    ThreadPlacement::instance().configure(cpus, numa_node.empty() ? -1 : static_cast<int>(parser.option("numa-node", size_t{0})));
+    std::cout << "Pinning threads to " << ThreadPlacement::instance().get_cpus().size() << " cores\n\n";
+  }
+
   // Load the hosts file
   Hosts hosts(parser.hostsPath());
   std::string result;
   result = "Loaded hosts (";
-  for (auto host : hosts.get_hosts()) {
+  for (const auto &host : hosts) {
     result += host.to_string() + ", ";
   }
   result.replace(result.end() - 2, result.end(), ")");
@@ -116,23 +120,67 @@ int main(int argc, char **argv) {
   global_output_file = &output_file;
   std::cout << "Opened output file at " << parser.outputPath() << "\n\n";
 
+  // Dump metrics to a file every interval (`--metrics path [--metrics-interval ms]`), SIGUSR1 dumps right away
+  std::string metrics_path = parser.option("metrics", std::string());
+  if (!metrics_path.empty()) {
+    Metrics::instance().start(metrics_path, parser.option("metrics-interval", METRICS_DEFAULT_INTERVAL_MS));
+    std::cout << "Dumping metrics to " << metrics_path << "\n\n";
+  }
+
+  // Record a Chrome trace, written on exit (`--trace path`)
+  std::string trace_path = parser.option("trace", std::string());
+  if (!trace_path.empty()) {
+    Tracer::instance().start(trace_path);
+    std::cout << "Tracing to " << trace_path << "\n\n";
+  }
+
+  // Reach peers on this machine through shared memory rings, UDP otherwise (`--transport shm`)
+  if (parser.option("transport", std::string("udp")) == "shm") {
+    Transport::set_factory(ShmTransport::create);
+    std::cout << "Using shared memory for local peers\n\n";
+  }
+
+  // Socket buffer size (`--socket-buffer bytes`, 0 for the system default), pace sends to each host unless `--pacing off`
+  UdpTransport::set_socket_buffer(parser.option("socket-buffer", static_cast<size_t>(UDP_DEFAULT_SOCKET_BUFFER)));
+  if (parser.option("pacing", std::string("on")) == "off") {
+    Pacer::set_enabled(false);
+    std::cout << "Sending without pacing\n\n";
+  }
+
+  // Hand the kernel up to 64 KB of datagrams per host at once and accept coalesced ones (`--gso on`)
+  if (parser.option("gso", std::string("off")) == "on") {
+    UdpTransport::set_segmentation(true);
+    std::cout << "Using UDP segmentation offload\n\n";
+  }
+
   // Instantiate lattice agreement
-  LatticeAgreement la(local_host, hosts, laDecide);
+  ProposalDomain domain(config.get_num_distinct_elements());
+  size_t window = parser.option("window", LA_DEFAULT_WINDOW);
+  LatticeAgreement la(local_host, hosts, domain, laDecide, window);
   global_la = &la;
 
   // Start proposing
   std::cout << "Timestamp: " << std::time(nullptr) * 1000 << "\n\n";
-  std::cout << "Proposing...\n\n";
-
-  for (size_t round=0; round<config.get_num_rounds(); round++) {
-    auto proposal = config.get_next_proposal();
-    la.propose(round, proposal);
-  }
-
-  // Infinite loop to keep the program running
-  while (!should_stop) {
-    std::this_thread::sleep_for(std::chrono::hours(1));
+  std::cout << "Proposing (window=" << window << ")...\n\n";
+
+  // Propose on a worker thread (propose() blocks on the window), main waits for the stop signal
+  std::thread proposer([&]() {
+    ThreadPlacement::place("proposer");
+    for (size_t round=0; round<config.get_num_rounds(); round++) {
+      auto proposal = config.get_next_proposal(domain);
+      la.propose(round, std::move(proposal));
+    }
+    la.flush();
+  });
+  proposer.detach();
+
+  // Wait for SIGINT/SIGTERM (dumping metrics on SIGUSR1), a second one terminates right away
+  int signum;
+  while ((signum = stop_signal.wait()) == SIGUSR1) {
+    Metrics::instance().dump();
   }
+  stop_signal.restore();
+  stop(signum);
 
   return 0;
 }
@@ -0,0 +1,91 @@
+// C++ standard library headers
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// C system headers
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Project headers
+#include "check.hpp"
+#include "ack_table.hpp"
+#include "hosts.hpp"
+#include "message.hpp"
+
+/**
+ * @brief AckTable with messages far ahead of the window
+ *
+ * @details Host 2 is the source of COUNT messages, more than twice
+ * ACK_TABLE_MAX_DIRECT. Host 2's relays arrive first, in reverse order, so
+ * most messages start in the map past the deque. Host 3's relays then arrive
+ * in order and make every message delivered by a majority, while the window
+ * slides over the entries taken in from the map. Every message must be relayed
+ * and delivered exactly once. A bogus sequence number from host 3 must cost an
+ * entry, not a window up to it.
+ */
+static const size_t COUNT = 2 * ACK_TABLE_MAX_DIRECT + 100;
+static const size_t BATCH = 1000;
+
+static BroadcastMessage message(size_t seq_number, size_t source_id) {
+    StringMessage m(std::to_string(seq_number));
+    return BroadcastMessage(m, seq_number, source_id);
+}
+
+// Relays of `sender` for the given messages of host 2, in batches; returns the number of relays
+static size_t relay(AckTable &table, size_t sender_id, const std::vector<size_t> &seq_numbers, std::vector<size_t> &delivered) {
+    size_t relays = 0;
+    for (size_t i = 0; i < seq_numbers.size(); i += BATCH) {
+        std::vector<AckTable::Event> events;
+        for (size_t j = i; j < std::min(i + BATCH, seq_numbers.size()); j++) {
+            events.push_back(AckTable::Event{sender_id, message(seq_numbers[j], 2)});
+        }
+        std::vector<BroadcastMessage> relayed, deliveries;
+        table.apply(events, relayed, deliveries);
+        relays += relayed.size();
+        for (const auto &bm : deliveries) {
+            CHECK(bm.get_source_id() == 2 && bm.get_seq_number() < COUNT);
+            delivered[bm.get_seq_number()]++;
+        }
+    }
+    return relays;
+}
+
+int main() {
+    Hosts hosts({Host(1, Address("127.0.0.1", 1)), Host(2, Address("127.0.0.1", 2)), Host(3, Address("127.0.0.1", 3))});
+    AckTable table(hosts);
+    std::vector<size_t> delivered(COUNT, 0);
+
+    std::vector<size_t> reverse, forward;
+    for (size_t i = 0; i < COUNT; i++) {
+        reverse.push_back(COUNT - 1 - i);
+        forward.push_back(i);
+    }
+
+    // One ack each, seen for the first time: relayed, not delivered
+    CHECK(relay(table, 2, reverse, delivered) == COUNT);
+    for (size_t count : delivered) { CHECK(count == 0); }
+
+    // A second ack is a majority of three hosts: everything delivered once, nothing relayed again
+    CHECK(relay(table, 3, forward, delivered) == 0);
+    for (size_t count : delivered) { CHECK(count == 1); }
+
+    // Late duplicates of delivered messages are ignored
+    CHECK(relay(table, 3, reverse, delivered) == 0);
+    for (size_t count : delivered) { CHECK(count == 1); }
+
+    // A bogus sequence number takes one entry instead of a window up to it
+    std::vector<AckTable::Event> events{AckTable::Event{3, message(std::numeric_limits<size_t>::max() / 2, 3)}};
+    std::vector<BroadcastMessage> relayed, deliveries;
+    table.apply(events, relayed, deliveries);
+    CHECK(relayed.size() == 1 && deliveries.empty());
+
+    std::cout << "ack_table: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <cstdlib>
+#include <iostream>
+
+/**
+ * @brief Minimal assertion for the unit tests, also active in release builds
+ */
+#define CHECK(condition)                                                                            \
+    do {                                                                                            \
+        if (!(condition)) {                                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            std::exit(1);                                                                           \
+        }                                                                                           \
+    } while (0)
@@ -0,0 +1,93 @@
+// C++ standard library headers
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// C system headers
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Project headers
+#include "check.hpp"
+#include "hosts.hpp"
+#include "proposal.hpp"
+#include "round_table.hpp"
+
+/**
+ * @brief RoundTable memory with a crashed host
+ *
+ * @details Host 1 (local) and host 2 decide ROUNDS rounds while host 3 never
+ * reports a decision, as if it crashed at the start. Round states must stay in
+ * the ring, and only the acceptor values of the last WINDOW *
+ * ROUND_TABLE_DECIDED_WINDOWS retired rounds are kept to answer late proposals.
+ * They go away once host 3 catches up. Proposers may only run past that
+ * horizon once host 3 has been silent for ROUND_TABLE_SILENT_NS.
+ */
+static const size_t WINDOW = 16;
+static const size_t ROUNDS = 100000;
+
+static void decide_rounds(RoundTable &table, ProposalDomain &domain, Round from, Round to) {
+    for (Round round = from; round < to; round++) {
+        Proposal proposal(domain);
+        proposal.insert(static_cast<ProposalValue>(round % 64));
+        CHECK(table.with_round(round, [&](RoundState &state) {
+            state.active = true;
+            state.active_proposal = proposal;
+            state.accepted_proposal = proposal;
+        }));
+        table.retire(round);
+        table.update_decided_below(1, round + 1);
+        table.update_decided_below(2, round + 1);
+    }
+}
+
+int main() {
+    Hosts hosts({Host(1, Address("127.0.0.1", 1)), Host(2, Address("127.0.0.1", 2)), Host(3, Address("127.0.0.1", 3))});
+    ProposalDomain domain(64);
+    RoundTable table(WINDOW, hosts);
+    size_t kept = WINDOW * ROUND_TABLE_DECIDED_WINDOWS;
+    CHECK(table.in_horizon(kept - 1));
+    CHECK(!table.in_horizon(kept));
+
+    decide_rounds(table, domain, 0, ROUNDS);
+    CHECK(table.get_retired_below() == ROUNDS);
+    CHECK(table.get_overflow_count() == 0);
+    CHECK(kept < ROUNDS);
+    CHECK(table.get_decided_count() == kept);
+
+    // A retired round takes no round state, recent late proposals see the acceptor value
+    CHECK(!table.with_round(0, [](RoundState &) {}));
+    Round recent = ROUNDS - kept;
+    bool answered = table.with_decided(recent, [&](Proposal &accepted) {
+        CHECK(accepted.size() == 1 && accepted.contains(static_cast<ProposalValue>(recent % 64)));
+    });
+    CHECK(answered);
+
+    // Older rounds expired, their late proposals stay unanswered
+    CHECK(!table.with_decided(0, [](Proposal &) {}));
+    CHECK(!table.with_decided(recent - 1, [](Proposal &) {}));
+
+    // Host 3 went silent, it no longer holds proposers back
+    std::this_thread::sleep_for(std::chrono::nanoseconds(ROUND_TABLE_SILENT_NS));
+    table.update_decided_below(1, ROUNDS);
+    table.update_decided_below(2, ROUNDS);
+    CHECK(table.in_horizon(ROUNDS + kept - 1));
+    CHECK(!table.in_horizon(ROUNDS + kept));
+
+    // Once host 3 has decided too, nothing is kept for the rounds
+    table.update_decided_below(3, ROUNDS);
+    CHECK(table.get_decided_count() == 0);
+    CHECK(!table.with_decided(0, [](Proposal &) {}));
+
+    decide_rounds(table, domain, ROUNDS, ROUNDS + WINDOW);
+    CHECK(table.get_overflow_count() == 0);
+    CHECK(table.get_decided_count() == WINDOW);
+
+    std::cout << "round_table: ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,73 @@
+// C++ standard library headers
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// C system headers
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+// Project headers
+#include "check.hpp"
+#include "hosts.hpp"
+#include "shm_transport.hpp"
+
+/**
+ * @brief ShmTransport with datagrams larger than a ring
+ *
+ * @details Host 2 sends a datagram of more than SHM_RING_BYTES to host 1 over
+ * its ShmTransport (falls back to the UDP socket), and host 3, a plain
+ * UdpTransport, sends one straight to host 1's socket (arrives through the
+ * forwarder). Both must arrive whole. The alarm fails the test if a datagram
+ * is lost and receive() blocks.
+ */
+static const size_t OVERSIZED_LENGTH = SHM_RING_BYTES + 8000;
+
+static std::vector<char> datagram(char fill) {
+    std::vector<char> payload(OVERSIZED_LENGTH, fill);
+    payload.front() = 'A';
+    payload.back() = 'Z';
+    return payload;
+}
+
+static void check_received(ShmTransport &transport, char fill) {
+    std::vector<char> buffer(ShmTransport::MAX_UDP_DATAGRAM_SIZE);
+    ssize_t length = transport.receive(buffer.data(), buffer.size());
+    CHECK(length == static_cast<ssize_t>(OVERSIZED_LENGTH));
+    buffer.resize(OVERSIZED_LENGTH);
+    CHECK(buffer == datagram(fill));
+}
+
+int main() {
+    alarm(10);
+    auto port = static_cast<uint16_t>(20000 + getpid() % 20000);
+    Hosts hosts({Host(1, Address("127.0.0.1", port)), Host(2, Address("127.0.0.1", static_cast<uint16_t>(port + 1))),
+                 Host(3, Address("127.0.0.1", static_cast<uint16_t>(port + 2)))});
+    CHECK(!ShmRing::fits(OVERSIZED_LENGTH));
+
+    ShmTransport receiver(hosts.get_host(1), hosts);
+    ShmTransport sender(hosts.get_host(2), hosts);
+    UdpTransport remote(hosts.get_host(3), hosts, false);
+
+    std::vector<char> payload = datagram('s');
+    sender.send(hosts.get_host(1), payload.data(), payload.size());
+    check_received(receiver, 's');
+
+    payload = datagram('u');
+    remote.send(hosts.get_host(1), payload.data(), payload.size());
+    check_received(receiver, 'u');
+
+    // Small datagrams still go through the ring
+    sender.send(hosts.get_host(1), "ring", 4);
+    char buffer[16];
+    CHECK(receiver.receive(buffer, sizeof(buffer)) == 4 && std::memcmp(buffer, "ring", 4) == 0);
+
+    std::cout << "shm_transport: ok" << std::endl;
+    return 0;
+}
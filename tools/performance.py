@@ -97,7 +97,8 @@ def main(args):
 
         print(f"Average Throughput: {sum(throughputs)/len(throughputs):.2f} messages/s")
     elif args.command == "agreement":
-        print("Lattice agreement validation not yet implemented 🚧")
+        # Output files carry no decision timestamps, the in-process driver measures them directly
+        print("Lattice agreement throughput: run `da_e2e --mode agreement` from the build directory")
 
 if __name__ == "__main__":
     parser = argparse.ArgumentParser()